@@ -0,0 +1,113 @@
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <atomic>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <process.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#endif
+#include "asset_cache.hpp"
+
+// FNV-1a over the raw bytes
+static uint64_t hash_bytes(uint64_t hash, const void *bytes, size_t size) {
+    const uint8_t *at = (const uint8_t *)bytes;
+    for(size_t i = 0; i < size; i++) {
+        hash = (hash ^ at[i])*0x100000001b3ull;
+    }
+    return hash;
+}
+
+uint64_t asset_fingerprint(const vector<string> &sources, const vector<float> &settings) {
+    uint64_t hash = hash_bytes(0xcbf29ce484222325ull, &asset_cache_version, sizeof(asset_cache_version));
+    for(auto &source : sources) {
+        // A missing source hashes as empty, so the cache keeps working
+        // wherever it was shipped without them
+        struct stat info;
+        int64_t size = 0, modified = 0;
+        if(stat(source.c_str(), &info) == 0) {
+            size = info.st_size;
+            modified = info.st_mtime;
+        }
+        hash = hash_bytes(hash, source.data(), source.size());
+        hash = hash_bytes(hash, &size, sizeof(size));
+        hash = hash_bytes(hash, &modified, sizeof(modified));
+    }
+    return hash_bytes(hash, settings.data(), settings.size()*sizeof(float));
+}
+
+static size_t aligned(size_t offset) {
+    return (offset + asset_alignment - 1)/asset_alignment*asset_alignment;
+}
+
+static size_t image_bytes(const AssetPixels &image) {
+    return (size_t)image.width*image.height*4;
+}
+
+bool write_asset_cache(const string &path, uint64_t fingerprint, AssetPixels table, AssetPixels balls,
+                       size_t ball_count, uint32_t atlas_columns, float atlas_cell, float atlas_scale) {
+    AssetCacheHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = asset_cache_magic;
+    header.version = asset_cache_version;
+    header.ball_count = ball_count;
+    header.fingerprint = fingerprint;
+    header.table = {table.width, table.height, aligned(sizeof(header))};
+    header.balls = {balls.width, balls.height, aligned(header.table.offset + image_bytes(table))};
+    header.atlas_columns = atlas_columns;
+    header.atlas_cell = atlas_cell;
+    header.atlas_scale = atlas_scale;
+
+    // Its own temporary per writer, so processes or threads racing to fill
+    // the same cache each rename a whole file into place
+    static atomic<unsigned> writes(0);
+    string temporary = path + "." + to_string(getpid()) + "." + to_string(writes++) + ".tmp";
+    FILE *file = fopen(temporary.c_str(), "wb");
+    if(!file) return false;
+
+    const uint8_t padding[asset_alignment] = {};
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+    ok = ok && fwrite(padding, 1, header.table.offset - sizeof(header), file) == header.table.offset - sizeof(header);
+    ok = ok && fwrite(table.pixels, 1, image_bytes(table), file) == image_bytes(table);
+    size_t gap = header.balls.offset - header.table.offset - image_bytes(table);
+    ok = ok && fwrite(padding, 1, gap, file) == gap;
+    ok = ok && fwrite(balls.pixels, 1, image_bytes(balls), file) == image_bytes(balls);
+    ok = fclose(file) == 0 && ok;
+
+#ifdef _WIN32
+    // rename does not replace an existing file here
+    if(ok) remove(path.c_str());
+#endif
+    if(!ok || rename(temporary.c_str(), path.c_str()) != 0) {
+        remove(temporary.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool AssetCache::open(const string &path, uint64_t fingerprint) {
+    close();
+    if(!file.open(path)) return false;
+
+    // Check every offset against the file before handing pixels out
+    size_t length = file.size();
+    header = (const AssetCacheHeader *)file.bytes();
+    auto fits = [&](const AssetImage &image) {
+        return image.offset <= length && (length - image.offset)/4/max<uint64_t>(image.width, 1) >= image.height;
+    };
+    bool valid = length >= sizeof(AssetCacheHeader) && header->magic == asset_cache_magic &&
+                 header->version == asset_cache_version && header->fingerprint == fingerprint &&
+                 fits(header->table) && fits(header->balls) && header->atlas_columns > 0 && header->ball_count > 0;
+    if(!valid) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+void AssetCache::close() {
+    file.close();
+    header = nullptr;
+}
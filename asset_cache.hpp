@@ -0,0 +1,102 @@
+#include <vector>
+#include <string>
+#include <cstdint>
+#include "mapped_file.hpp"
+
+#pragma once
+
+using namespace std;
+
+// Everything the viewer rasterizes at startup, kept in one file so a
+// later start maps it instead of decoding and drawing it again.
+//
+//   header      AssetCacheHeader
+//   table       RGBA8 pixels of the decoded table image
+//   balls       RGBA8 pixels of the ball atlas, every ball sprite with
+//               its number 0-15 already drawn in, so neither the font
+//               nor the ball shapes are needed to draw a ball
+//
+// Pixel blocks start on asset_alignment so they can be handed straight
+// to the texture upload. The fingerprint covers the size and time of each
+// source file and the bake settings, a cache that does not match is
+// ignored and written again.
+
+const uint32_t asset_cache_magic = 0x54534142; // "BAST"
+const uint16_t asset_cache_version = 1;
+const size_t   asset_alignment = 64;
+
+#pragma pack(push, 1)
+struct AssetImage {
+    uint32_t width;
+    uint32_t height;
+    uint64_t offset;
+};
+
+struct AssetCacheHeader {
+    uint32_t   magic;
+    uint16_t   version;
+    uint16_t   ball_count;
+    uint64_t   fingerprint;
+    AssetImage table;
+    AssetImage balls;
+    // Atlas layout, as BallBatch baked it
+    uint32_t   atlas_columns;
+    float      atlas_cell;
+    float      atlas_scale;
+};
+#pragma pack(pop)
+
+// RGBA8 pixels, row after row
+struct AssetPixels {
+    const uint8_t *pixels;
+    uint32_t       width;
+    uint32_t       height;
+};
+
+uint64_t asset_fingerprint(const vector<string> &sources, const vector<float> &settings);
+
+// Written to a temporary file and renamed over path, so viewers starting
+// at the same time never map half a cache
+bool write_asset_cache(const string &path, uint64_t fingerprint, AssetPixels table, AssetPixels balls,
+                       size_t ball_count, uint32_t atlas_columns, float atlas_cell, float atlas_scale);
+
+class AssetCache {
+    private:
+    MappedFile              file;
+    const AssetCacheHeader *header;
+
+    AssetPixels image(const AssetImage &entry) const {
+        return {file.bytes() + entry.offset, entry.width, entry.height};
+    }
+
+    public:
+    AssetCache() {
+        header = nullptr;
+    }
+
+    // False unless the file is whole and was made from fingerprint
+    bool open(const string &path, uint64_t fingerprint);
+    void close();
+    bool is_open() const {
+        return header != nullptr;
+    }
+
+    AssetPixels table() const {
+        return image(header->table);
+    }
+    AssetPixels balls() const {
+        return image(header->balls);
+    }
+    size_t ball_count() const {
+        return header->ball_count;
+    }
+    uint32_t atlas_columns() const {
+        return header->atlas_columns;
+    }
+    float atlas_cell() const {
+        return header->atlas_cell;
+    }
+    float atlas_scale() const {
+        return header->atlas_scale;
+    }
+};
@@ -0,0 +1,196 @@
+#include "ball_store.hpp"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define BALL_STORE_X86
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+// Arena
+
+// Slots come in multiples of 8, the AVX2 kernels' width
+static size_t round_slots(size_t n) {
+    return (n + 7)/8*8;
+}
+
+void BallStore::bind() {
+    uint8_t *base = arena.data();
+    size_t run = slots*sizeof(float);
+    x = BallField<float>((float *)(base), count);
+    y = BallField<float>((float *)(base + run), count);
+    vx = BallField<float>((float *)(base + 2*run), count);
+    vy = BallField<float>((float *)(base + 3*run), count);
+    friction = BallField<float>((float *)(base + 4*run), count);
+    radius = BallField<float>((float *)(base + 5*run), count);
+    mass = BallField<float>((float *)(base + 6*run), count);
+    flags = BallField<uint32_t>((uint32_t *)(base + 7*run), count);
+    pocket = BallField<int8_t>((int8_t *)(base + 8*run), count);
+}
+
+// Moves every field to its place in a bigger arena
+void BallStore::reserve_slots(size_t wanted) {
+    size_t grown = round_slots(wanted);
+    vector<uint8_t> bigger(8*grown*sizeof(float) + grown*sizeof(int8_t));
+    size_t old_run = slots*sizeof(float), new_run = grown*sizeof(float);
+    for(int field = 0; field < 8; field++) {
+        copy_n(arena.data() + field*old_run, count*sizeof(float), bigger.data() + field*new_run);
+    }
+    copy_n(arena.data() + 8*old_run, count*sizeof(int8_t), bigger.data() + 8*new_run);
+
+    arena.swap(bigger);
+    slots = grown;
+    bind();
+}
+
+// Kernels
+
+// Every kernel does the same float operations in the same order as the
+// scalar one, so results do not depend on which kernel the CPU picked.
+//
+//   a  = v*friction*-1
+//   p += v*dt + a*dt*dt/2
+//   v += a*dt
+//
+// A ball flagged as moving that drops under moving_threshold is stopped.
+
+static inline void integrate_one(BallStore *balls, size_t i, float dt, float threshold_squared) {
+    float ax = balls->vx[i]*balls->friction[i]*-1;
+    float ay = balls->vy[i]*balls->friction[i]*-1;
+
+    balls->x[i] = balls->x[i] + balls->vx[i]*dt + ax*dt*dt/2.f;
+    balls->y[i] = balls->y[i] + balls->vy[i]*dt + ay*dt*dt/2.f;
+    balls->vx[i] = balls->vx[i] + ax*dt;
+    balls->vy[i] = balls->vy[i] + ay*dt;
+
+    float speed_squared = balls->vx[i]*balls->vx[i] + balls->vy[i]*balls->vy[i];
+    if((balls->flags[i] & BALL_MOVING) && speed_squared < threshold_squared) {
+        balls->vx[i] = 0.f;
+        balls->vy[i] = 0.f;
+        balls->flags[i] &= ~BALL_MOVING;
+    }
+}
+
+static void integrate_scalar(BallStore *balls, size_t begin, float dt) {
+    const float threshold_squared = moving_threshold*moving_threshold;
+    for(size_t i = begin; i < balls->size(); i++) {
+        integrate_one(balls, i, dt, threshold_squared);
+    }
+}
+
+#ifdef BALL_STORE_X86
+
+__attribute__((target("avx2")))
+static size_t integrate_avx2(BallStore *balls, float dt) {
+    const __m256 step = _mm256_set1_ps(dt);
+    const __m256 two = _mm256_set1_ps(2.f);
+    const __m256 minus_one = _mm256_set1_ps(-1.f);
+    const __m256 threshold_squared = _mm256_set1_ps(moving_threshold*moving_threshold);
+    const __m256i moving_bit = _mm256_set1_epi32(BALL_MOVING);
+
+    size_t i = 0;
+    for(; i + 8 <= balls->size(); i += 8) {
+        __m256 x = _mm256_loadu_ps(&balls->x[i]);
+        __m256 y = _mm256_loadu_ps(&balls->y[i]);
+        __m256 vx = _mm256_loadu_ps(&balls->vx[i]);
+        __m256 vy = _mm256_loadu_ps(&balls->vy[i]);
+        __m256 f = _mm256_loadu_ps(&balls->friction[i]);
+        __m256i flags = _mm256_loadu_si256((const __m256i*)&balls->flags[i]);
+
+        __m256 ax = _mm256_mul_ps(_mm256_mul_ps(vx, f), minus_one);
+        __m256 ay = _mm256_mul_ps(_mm256_mul_ps(vy, f), minus_one);
+
+        x = _mm256_add_ps(_mm256_add_ps(x, _mm256_mul_ps(vx, step)), _mm256_div_ps(_mm256_mul_ps(_mm256_mul_ps(ax, step), step), two));
+        y = _mm256_add_ps(_mm256_add_ps(y, _mm256_mul_ps(vy, step)), _mm256_div_ps(_mm256_mul_ps(_mm256_mul_ps(ay, step), step), two));
+        vx = _mm256_add_ps(vx, _mm256_mul_ps(ax, step));
+        vy = _mm256_add_ps(vy, _mm256_mul_ps(ay, step));
+
+        __m256 speed_squared = _mm256_add_ps(_mm256_mul_ps(vx, vx), _mm256_mul_ps(vy, vy));
+        __m256 slow = _mm256_cmp_ps(speed_squared, threshold_squared, _CMP_LT_OQ);
+        __m256i was_moving = _mm256_cmpeq_epi32(_mm256_and_si256(flags, moving_bit), moving_bit);
+        __m256 stop = _mm256_and_ps(slow, _mm256_castsi256_ps(was_moving));
+
+        vx = _mm256_andnot_ps(stop, vx);
+        vy = _mm256_andnot_ps(stop, vy);
+        flags = _mm256_andnot_si256(_mm256_and_si256(_mm256_castps_si256(stop), moving_bit), flags);
+
+        _mm256_storeu_ps(&balls->x[i], x);
+        _mm256_storeu_ps(&balls->y[i], y);
+        _mm256_storeu_ps(&balls->vx[i], vx);
+        _mm256_storeu_ps(&balls->vy[i], vy);
+        _mm256_storeu_si256((__m256i*)&balls->flags[i], flags);
+    }
+    return i;
+}
+
+static size_t integrate_sse2(BallStore *balls, float dt) {
+    const __m128 step = _mm_set1_ps(dt);
+    const __m128 two = _mm_set1_ps(2.f);
+    const __m128 minus_one = _mm_set1_ps(-1.f);
+    const __m128 threshold_squared = _mm_set1_ps(moving_threshold*moving_threshold);
+    const __m128i moving_bit = _mm_set1_epi32(BALL_MOVING);
+
+    size_t i = 0;
+    for(; i + 4 <= balls->size(); i += 4) {
+        __m128 x = _mm_loadu_ps(&balls->x[i]);
+        __m128 y = _mm_loadu_ps(&balls->y[i]);
+        __m128 vx = _mm_loadu_ps(&balls->vx[i]);
+        __m128 vy = _mm_loadu_ps(&balls->vy[i]);
+        __m128 f = _mm_loadu_ps(&balls->friction[i]);
+        __m128i flags = _mm_loadu_si128((const __m128i*)&balls->flags[i]);
+
+        __m128 ax = _mm_mul_ps(_mm_mul_ps(vx, f), minus_one);
+        __m128 ay = _mm_mul_ps(_mm_mul_ps(vy, f), minus_one);
+
+        x = _mm_add_ps(_mm_add_ps(x, _mm_mul_ps(vx, step)), _mm_div_ps(_mm_mul_ps(_mm_mul_ps(ax, step), step), two));
+        y = _mm_add_ps(_mm_add_ps(y, _mm_mul_ps(vy, step)), _mm_div_ps(_mm_mul_ps(_mm_mul_ps(ay, step), step), two));
+        vx = _mm_add_ps(vx, _mm_mul_ps(ax, step));
+        vy = _mm_add_ps(vy, _mm_mul_ps(ay, step));
+
+        __m128 speed_squared = _mm_add_ps(_mm_mul_ps(vx, vx), _mm_mul_ps(vy, vy));
+        __m128 slow = _mm_cmplt_ps(speed_squared, threshold_squared);
+        __m128i was_moving = _mm_cmpeq_epi32(_mm_and_si128(flags, moving_bit), moving_bit);
+        __m128 stop = _mm_and_ps(slow, _mm_castsi128_ps(was_moving));
+
+        vx = _mm_andnot_ps(stop, vx);
+        vy = _mm_andnot_ps(stop, vy);
+        flags = _mm_andnot_si128(_mm_and_si128(_mm_castps_si128(stop), moving_bit), flags);
+
+        _mm_storeu_ps(&balls->x[i], x);
+        _mm_storeu_ps(&balls->y[i], y);
+        _mm_storeu_ps(&balls->vx[i], vx);
+        _mm_storeu_ps(&balls->vy[i], vy);
+        _mm_storeu_si128((__m128i*)&balls->flags[i], flags);
+    }
+    return i;
+}
+
+static bool has_avx2() {
+    static const bool supported = __builtin_cpu_supports("avx2");
+    return supported;
+}
+
+#endif
+
+void integrate(BallStore *balls, float dt) {
+    size_t done = 0;
+#ifdef BALL_STORE_X86
+    done = has_avx2() ? integrate_avx2(balls, dt) : integrate_sse2(balls, dt);
+#endif
+    integrate_scalar(balls, done, dt);
+}
+
+void integrate(BallStore *balls, const vector<uint32_t> &indices, float dt) {
+    const float threshold_squared = moving_threshold*moving_threshold;
+    for(uint32_t i : indices) {
+        integrate_one(balls, i, dt, threshold_squared);
+    }
+}
+
+bool any_moving(const BallStore *balls) {
+    uint32_t moving = 0;
+    for(uint32_t flag : balls->flags) {
+        moving |= flag;
+    }
+    return moving & BALL_MOVING;
+}
@@ -0,0 +1,216 @@
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include "vector_functions.hpp"
+
+#pragma once
+
+using namespace std;
+
+const float moving_threshold = 10.f;
+
+enum ball_flag : uint32_t {
+    BALL_MOVING = 1,
+    BALL_POCKETED = 2
+};
+
+// Description of a single ball, used to add balls to a BallStore and to
+// read one back out. The store itself keeps no Ball objects.
+
+class Ball {
+    public:
+    Vector2<float>    position, velocity;
+    float             radius, mass;
+    float             friction;
+    int               number;
+    int               pocket;
+    bool              is_moving;
+
+    Ball(float x, float y, float r, float m, float f, int num) {
+        position = Vector2<float>{x, y};
+        velocity = Vector2<float>{0, 0};
+        radius = r;
+        mass = m;
+        friction = f;
+        number = num;
+        pocket = -1;
+        is_moving = false;
+    }
+};
+
+// Fixed-size window onto one field of a BallStore, indexed by ball
+// number like the vector it replaces. It points into the store's arena,
+// so it is only valid until the store grows or is assigned to.
+
+template<class T>
+class BallField {
+    private:
+    T      *values;
+    size_t  count;
+
+    public:
+    BallField() {
+        values = nullptr;
+        count = 0;
+    }
+
+    BallField(T *at, size_t n) {
+        values = at;
+        count = n;
+    }
+
+    T &operator[](size_t i) { return values[i]; }
+    const T &operator[](size_t i) const { return values[i]; }
+
+    T *data() { return values; }
+    const T *data() const { return values; }
+    size_t size() const { return count; }
+
+    T *begin() { return values; }
+    T *end() { return values + count; }
+    const T *begin() const { return values; }
+    const T *end() const { return values + count; }
+};
+
+// Structure-of-arrays ball state. Index i is ball number i, every field
+// has size() entries and integrate() runs over all of them at once.
+//
+// All fields share one arena, each field a run of capacity() entries, so
+// copying a store is one block copy and, once the target has room, never
+// touches the heap. Ball numbers are the stable handles: pointers into
+// the fields move when the store grows, numbers never change.
+
+class BallStore {
+    private:
+    vector<uint8_t> arena;
+    size_t          count;
+    size_t          slots;
+
+    // Lays the fields out over the arena for the current count and slots
+    void bind();
+    void reserve_slots(size_t wanted);
+
+    public:
+    BallField<float>    x, y;
+    BallField<float>    vx, vy;
+    BallField<float>    friction;
+    BallField<float>    radius, mass;
+    BallField<uint32_t> flags;
+    // Index into PhysicsWorld::pockets, -1 while on the table
+    BallField<int8_t>   pocket;
+
+    BallStore() {
+        count = 0;
+        slots = 0;
+    }
+
+    BallStore(const BallStore &other) {
+        count = 0;
+        slots = 0;
+        *this = other;
+    }
+
+    BallStore &operator=(const BallStore &other) {
+        if(this == &other) return *this;
+        arena = other.arena;
+        count = other.count;
+        slots = other.slots;
+        bind();
+        return *this;
+    }
+
+    size_t size() const {
+        return count;
+    }
+
+    size_t capacity() const {
+        return slots;
+    }
+
+    // Room for n balls without growing the arena again
+    void reserve(size_t n) {
+        if(n > slots) reserve_slots(n);
+    }
+
+    // The arena as it is, fields at fixed offsets and no pointers, so a
+    // copy of these bytes is the whole store
+    size_t state_size() const {
+        return arena.size();
+    }
+
+    void save_state(uint8_t *to) const {
+        memcpy(to, arena.data(), arena.size());
+    }
+
+    // Only from save_state() on a store with the same balls and capacity
+    void restore_state(const uint8_t *from) {
+        memcpy(arena.data(), from, arena.size());
+    }
+
+    // Keeps the arena, refilling it with as many balls never reallocates
+    void clear() {
+        count = 0;
+        bind();
+    }
+
+    void push_back(const Ball &ball) {
+        if(count == slots) reserve_slots(max<size_t>(16, slots*2));
+        count++;
+        bind();
+
+        size_t i = count - 1;
+        x[i] = ball.position.x;
+        y[i] = ball.position.y;
+        // A sleeping ball keeps no velocity, the full integrate pass
+        // would move it otherwise
+        vx[i] = ball.is_moving ? ball.velocity.x : 0.f;
+        vy[i] = ball.is_moving ? ball.velocity.y : 0.f;
+        friction[i] = ball.friction;
+        radius[i] = ball.radius;
+        mass[i] = ball.mass;
+        flags[i] = (ball.is_moving ? (uint32_t)BALL_MOVING : 0u) | (ball.pocket >= 0 ? (uint32_t)BALL_POCKETED : 0u);
+        pocket[i] = ball.pocket;
+    }
+
+    Ball get(size_t i) const {
+        Ball ball(x[i], y[i], radius[i], mass[i], friction[i], (int)i);
+        ball.velocity = velocity(i);
+        ball.is_moving = is_moving(i);
+        ball.pocket = pocket[i];
+        return ball;
+    }
+
+    Vector2<float> position(size_t i) const {
+        return {x[i], y[i]};
+    }
+
+    Vector2<float> velocity(size_t i) const {
+        return {vx[i], vy[i]};
+    }
+
+    void set_position(size_t i, Vector2<float> pos) {
+        x[i] = pos.x;
+        y[i] = pos.y;
+    }
+
+    void set_velocity(size_t i, Vector2<float> vel) {
+        vx[i] = vel.x;
+        vy[i] = vel.y;
+    }
+
+    bool is_moving(size_t i) const {
+        return flags[i] & BALL_MOVING;
+    }
+
+    bool is_pocketed(size_t i) const {
+        return flags[i] & BALL_POCKETED;
+    }
+};
+
+// Kernels, vectorized with AVX2 or SSE2 where the CPU has them
+
+void integrate(BallStore *balls, float dt);
+// Only the listed balls, bit-identical to the full pass for them
+void integrate(BallStore *balls, const vector<uint32_t> &indices, float dt);
+bool any_moving(const BallStore *balls);
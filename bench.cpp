@@ -0,0 +1,743 @@
+#include <cstring>
+#include <cstdlib>
+#include <random>
+#include "bench.hpp"
+#include "physics.hpp"
+#include "event_engine.hpp"
+#include "trajectory.hpp"
+#include "precision_world.hpp"
+#include "table_batch.hpp"
+#include "shot_preview.hpp"
+#include "scenario.hpp"
+#include "rollback.hpp"
+#include "thread_pool.hpp"
+#ifdef BENCH_DRAW
+#include "classes.hpp"
+#include "asset_cache.hpp"
+#endif
+
+using namespace std;
+
+// Repeatable scenarios for the physics and drawing hot paths.
+//
+//   ./bench [--json <file|->] [--repeats <n>] [--quick] [--scenario <file>]...
+//
+// Build with `make bench SFML=1` to include the draw-only frame.
+
+const float tick_dt = 1.f/120.f;
+const int max_ticks = 120*60;
+
+struct PhaseTimes {
+    double integrate_ns;
+    double collision_ns;
+    long   sub_steps;
+};
+
+// Same sub-steps as PhysicsWorld::update(), with each phase timed
+PhaseTimes run_timed(PhysicsWorld *world, int ticks, bool until_rest) {
+    PhaseTimes times = {0, 0, 0};
+    float sub_dt = tick_dt/sub_updates;
+
+    for(int tick = 0; tick < ticks; tick++) {
+        if(until_rest && world->none_moving()) break;
+        for(int i = 0; i < sub_updates; i++) {
+            auto start = chrono::steady_clock::now();
+            world->sub_update(sub_dt);
+            auto integrated = chrono::steady_clock::now();
+            world->ball_to_ball_collision();
+            world->check_ball_line_collision();
+            world->check_ball_pocket_collision();
+            auto collided = chrono::steady_clock::now();
+
+            times.integrate_ns += chrono::duration<double, nano>(integrated - start).count();
+            times.collision_ns += chrono::duration<double, nano>(collided - integrated).count();
+            times.sub_steps++;
+        }
+    }
+    return times;
+}
+
+// Untimed phases, wall time of update() until every ball stops
+double shot_to_rest_ns(PhysicsWorld world) {
+    auto start = chrono::steady_clock::now();
+    for(int tick = 0; tick < max_ticks && !world.none_moving(); tick++) {
+        world.update(tick_dt);
+    }
+    return seconds_since(start)*1e9;
+}
+
+void report_phases(BenchReport *report, const string &scenario, const vector<PhaseTimes> &runs) {
+    vector<double> sub_step, integrate, collision;
+    long sub_steps = 0;
+    for(auto &run : runs) {
+        if(run.sub_steps == 0) continue;
+        sub_step.push_back((run.integrate_ns + run.collision_ns)/run.sub_steps);
+        integrate.push_back(run.integrate_ns/run.sub_steps);
+        collision.push_back(run.collision_ns/run.sub_steps);
+        sub_steps += run.sub_steps;
+    }
+    report->add(scenario, "ns_per_sub_step", median(sub_step), sub_steps);
+    report->add(scenario, "ns_per_integrate", median(integrate), sub_steps);
+    report->add(scenario, "ns_per_collision_pass", median(collision), sub_steps);
+}
+
+// Scenarios
+
+PhysicsWorld break_table() {
+    PhysicsWorld world;
+    setup_standard_table(&world, 1);
+    world.balls.set_velocity(0, {30.f, -2400.f});
+    world.wake(0);
+    return world;
+}
+
+void bench_break(BenchReport *report, int repeats) {
+    vector<PhaseTimes> runs;
+    vector<double> to_rest, events_to_rest;
+    long events = 0;
+
+    for(int r = 0; r < repeats; r++) {
+        PhysicsWorld world = break_table();
+        runs.push_back(run_timed(&world, max_ticks, true));
+        to_rest.push_back(shot_to_rest_ns(break_table()));
+
+        PhysicsWorld event_world = break_table();
+        EventEngine engine;
+        auto start = chrono::steady_clock::now();
+        engine.reset(&event_world);
+        events = engine.run_to_rest(&event_world, 1000000);
+        events_to_rest.push_back(seconds_since(start)*1e9);
+    }
+
+    report_phases(report, "break", runs);
+    report->add("break", "ns_per_shot_to_rest", median(to_rest), repeats);
+    report->add("break_events", "ns_per_shot_to_rest", median(events_to_rest), repeats);
+    report->add("break_events", "events_to_rest", events, 1);
+}
+
+void bench_stress(BenchReport *report, int repeats, int balls) {
+    vector<PhaseTimes> runs;
+    for(int r = 0; r < repeats; r++) {
+        PhysicsWorld world;
+        generate_stress_field(&world, balls, stress_table_scale(balls), 1);
+        runs.push_back(run_timed(&world, 30, false));
+    }
+    report_phases(report, "stress_" + to_string(balls), runs);
+}
+
+// update() with sub_steps sub-steps, ticks until every ball rests
+int run_to_rest(PhysicsWorld *world, int sub_steps) {
+    float sub_dt = tick_dt/sub_steps;
+    int tick = 0;
+    for(; tick < max_ticks && !world->none_moving(); tick++) {
+        for(int i = 0; i < sub_steps; i++) {
+            world->sub_update(sub_dt);
+            world->ball_to_ball_collision();
+            world->check_ball_line_collision();
+            world->check_ball_pocket_collision();
+        }
+    }
+    return tick;
+}
+
+// Deepest overlap left between two balls on the table
+float worst_overlap(const PhysicsWorld &world) {
+    const BallStore &balls = world.balls;
+    float worst = 0.f;
+    for(size_t i = 0; i < balls.size(); i++) {
+        for(size_t j = 0; j < i; j++) {
+            if(balls.is_pocketed(i) || balls.is_pocketed(j)) continue;
+            float overlap = balls.radius[i] + balls.radius[j] - distance(balls.position(i), balls.position(j));
+            worst = max(worst, overlap);
+        }
+    }
+    return worst;
+}
+
+// The break resolved pair by pair against the coloured contact solver,
+// at the usual 8 sub-steps and at fewer. Besides the cost, how long the
+// rack takes to settle and how much overlap it is left with show whether
+// fewer sub-steps stay stable.
+void bench_contacts(BenchReport *report, int repeats) {
+    struct Setup {
+        const char         *name;
+        contact_solver_type mode;
+        int                 sub_steps;
+    };
+    const Setup setups[] = {
+        {"break_sequential_8", SEQUENTIAL_CONTACTS, 8}, {"break_sequential_4", SEQUENTIAL_CONTACTS, 4},
+        {"break_sequential_2", SEQUENTIAL_CONTACTS, 2}, {"break_colored_8", COLORED_CONTACTS, 8},
+        {"break_colored_4", COLORED_CONTACTS, 4}, {"break_colored_2", COLORED_CONTACTS, 2}
+    };
+    const int seeds = 16;
+
+    for(auto &setup : setups) {
+        vector<double> break_ns;
+        double ticks = 0, overlap = 0;
+        for(int r = 0; r < repeats; r++) {
+            double total_ns = 0;
+            for(int seed = 0; seed < seeds; seed++) {
+                PhysicsWorld world;
+                setup_standard_table(&world, seed);
+                world.contact_mode = setup.mode;
+                world.balls.set_velocity(0, {30.f, -2400.f});
+                world.wake(0);
+
+                auto start = chrono::steady_clock::now();
+                int rest = run_to_rest(&world, setup.sub_steps);
+                total_ns += seconds_since(start)*1e9;
+                if(r == 0) {
+                    ticks += rest;
+                    overlap = max(overlap, (double)worst_overlap(world));
+                }
+            }
+            break_ns.push_back(total_ns/seeds);
+        }
+        report->add(setup.name, "ns_per_break", median(break_ns), repeats*seeds);
+        report->add(setup.name, "ticks_to_rest", ticks/seeds, seeds);
+        report->add(setup.name, "worst_overlap", overlap, seeds);
+    }
+}
+
+// A crowded stress field, where the first contact colour is past
+// parallel_threshold, sequential against coloured on this thread and
+// coloured over the pool
+void bench_contact_pool(BenchReport *report, int repeats, ThreadPool *pool) {
+    const int balls = 20000, ticks = 5;
+    struct Setup {
+        const char         *name;
+        contact_solver_type mode;
+        ThreadPool         *pool;
+    };
+    const Setup setups[] = {
+        {"_sequential", SEQUENTIAL_CONTACTS, nullptr}, {"_colored", COLORED_CONTACTS, nullptr},
+        {"_colored_pool", COLORED_CONTACTS, pool}
+    };
+
+    for(auto &setup : setups) {
+        string name = "stress_" + to_string(balls) + setup.name;
+        vector<PhaseTimes> runs;
+        long batches = 0;
+        for(int r = 0; r < repeats; r++) {
+            PhysicsWorld world;
+            generate_stress_field(&world, balls, stress_table_scale(balls), 1);
+            world.contact_mode = setup.mode;
+            world.contact_pool = setup.pool;
+            runs.push_back(run_timed(&world, ticks, false));
+            batches += world.contact_solver.pool_batches;
+        }
+        report_phases(report, name, runs);
+        if(setup.pool) report->add(name, "pool_batches_per_run", (double)batches/repeats, repeats);
+    }
+}
+
+// The break through update() with fixed and adaptive sub-steps, then
+// the cost of a tick once the table rests
+void bench_sub_steps(BenchReport *report, int repeats) {
+    const pair<const char *, sub_step_type> modes[] = {
+        {"break_fixed_steps", FIXED_SUB_STEPS}, {"break_adaptive_steps", ADAPTIVE_SUB_STEPS}
+    };
+    for(auto &mode : modes) {
+        vector<double> to_rest;
+        long ticks = 0, sub_steps = 0;
+        for(int r = 0; r < repeats; r++) {
+            PhysicsWorld world = break_table();
+            world.sub_step_mode = mode.second;
+            to_rest.push_back(shot_to_rest_ns(world));
+
+            if(r > 0) continue;
+            for(; ticks < max_ticks && !world.none_moving(); ticks++) {
+                sub_steps += world.sub_steps(tick_dt);
+                world.update(tick_dt);
+            }
+        }
+        report->add(mode.first, "ns_per_shot_to_rest", median(to_rest), repeats);
+        report->add(mode.first, "sub_steps_per_tick", (double)sub_steps/max(1L, ticks), ticks);
+    }
+
+    vector<double> idle_ns;
+    const int idle_ticks = 10000;
+    for(int r = 0; r < repeats; r++) {
+        PhysicsWorld world;
+        setup_standard_table(&world, 1);
+        auto start = chrono::steady_clock::now();
+        for(int tick = 0; tick < idle_ticks; tick++) {
+            world.update(tick_dt);
+        }
+        idle_ns.push_back(seconds_since(start)*1e9/idle_ticks);
+    }
+    report->add("idle_table", "ns_per_update", median(idle_ns), repeats*idle_ticks);
+}
+
+// A scenario file, e.g. a synthetic table from billiards-scenario: the
+// load, then 30 ticks from the state it was saved in
+void bench_scenario(BenchReport *report, int repeats, const string &path, ThreadPool *pool) {
+    string name = "scenario_" + path.substr(path.find_last_of("/\\") + 1);
+    vector<PhaseTimes> runs, colored_runs;
+    vector<double> load_ns;
+    for(int r = 0; r < repeats; r++) {
+        PhysicsWorld world;
+        string error;
+        auto start = chrono::steady_clock::now();
+        if(!load_scenario(path, &world, nullptr, &error)) {
+            printf("%s: %s, skipped\n", path.c_str(), error.c_str());
+            return;
+        }
+        load_ns.push_back(seconds_since(start)*1e9);
+        PhysicsWorld colored = world;
+        runs.push_back(run_timed(&world, 30, false));
+
+        colored.contact_mode = COLORED_CONTACTS;
+        colored.contact_pool = pool;
+        colored_runs.push_back(run_timed(&colored, 30, false));
+    }
+    report->add(name, "ms_to_load", median(load_ns)/1e6, repeats);
+    report_phases(report, name, runs);
+    report_phases(report, name + "_colored_pool", colored_runs);
+}
+
+// Lone cue ball banked around the table at full power
+void bench_bank(BenchReport *report, int repeats) {
+    const int shots = 8;
+    vector<PhaseTimes> runs;
+    vector<double> to_rest;
+
+    for(int r = 0; r < repeats; r++) {
+        PhaseTimes total = {0, 0, 0};
+        double shot_ns = 0;
+        for(int s = 0; s < shots; s++) {
+            PhysicsWorld world;
+            setup_standard_table(&world, 1);
+            Ball cue = world.balls.get(0);
+            world.balls.clear();
+            world.balls.push_back(cue);
+
+            float angle = 0.3f + 0.7f*s;
+            world.balls.set_velocity(0, {cosf(angle)*5000.f, sinf(angle)*5000.f});
+            world.wake(0);
+
+            shot_ns += shot_to_rest_ns(world);
+            PhaseTimes times = run_timed(&world, max_ticks, true);
+            total.integrate_ns += times.integrate_ns;
+            total.collision_ns += times.collision_ns;
+            total.sub_steps += times.sub_steps;
+        }
+        runs.push_back(total);
+        to_rest.push_back(shot_ns/shots);
+    }
+
+    report_phases(report, "bank", runs);
+    report->add("bank", "ns_per_shot_to_rest", median(to_rest), repeats*shots);
+}
+
+// What-if search setup cost: copying a table into a world that already
+// held one, and racking it again in place
+void bench_clone(BenchReport *report, int repeats) {
+    const int copies = 10000;
+    PhysicsWorld table = break_table();
+    PhysicsWorld scratch = table;
+    vector<double> clone_ns, rack_ns;
+
+    for(int r = 0; r < repeats; r++) {
+        auto start = chrono::steady_clock::now();
+        for(int c = 0; c < copies; c++) {
+            scratch = table;
+        }
+        clone_ns.push_back(seconds_since(start)*1e9/copies);
+
+        start = chrono::steady_clock::now();
+        for(int c = 0; c < copies; c++) {
+            scratch.rack(c);
+        }
+        rack_ns.push_back(seconds_since(start)*1e9/copies);
+    }
+    report->add("clone", "ns_per_clone", median(clone_ns), repeats*copies);
+    report->add("clone", "ns_per_rack", median(rack_ns), repeats*copies);
+}
+
+// Saving and restoring the world for rollback, and the worst rollback
+// there is: the break shot turning up max_rollback frames late
+void bench_rollback(BenchReport *report, int repeats) {
+    const int copies = 10000, late = 16;
+    PhysicsWorld world = break_table();
+    vector<uint8_t> state(world.state_size());
+    vector<double> save_ns, restore_ns, rollback_ns;
+
+    for(int r = 0; r < repeats; r++) {
+        auto start = chrono::steady_clock::now();
+        for(int c = 0; c < copies; c++) {
+            world.save_state(state.data());
+        }
+        save_ns.push_back(seconds_since(start)*1e9/copies);
+
+        start = chrono::steady_clock::now();
+        for(int c = 0; c < copies; c++) {
+            world.restore_state(state.data());
+        }
+        restore_ns.push_back(seconds_since(start)*1e9/copies);
+
+        PhysicsWorld table;
+        setup_standard_table(&table, 1);
+        RollbackSession session(table, 2, late);
+        for(long frame = 0; frame <= late; frame++) {
+            session.add_input({(uint32_t)frame, 0, 0, {0.f, 0.f}});
+            if(frame != 1) session.add_input({(uint32_t)frame, 1, 0, {0.f, 0.f}});
+            session.advance();
+        }
+        session.add_input({1, 1, 1, {30.f, -2400.f}});
+        start = chrono::steady_clock::now();
+        session.resimulate();
+        rollback_ns.push_back(seconds_since(start)*1e9);
+    }
+    report->add("rollback", "ns_per_save", median(save_ns), repeats*copies);
+    report->add("rollback", "ns_per_restore", median(restore_ns), repeats*copies);
+    report->add("rollback", "ns_per_late_break", median(rollback_ns), repeats);
+}
+
+// Aim preview as the render loop sees it: what aim() costs a frame when
+// the aim has not moved enough to predict again, and how long a new aim
+// takes to come back as a finished path
+void bench_preview(BenchReport *report, int repeats) {
+    const int frames = 10000, aims = 20;
+    PhysicsWorld table = break_table();
+    vector<float> x(table.balls.x.begin(), table.balls.x.end());
+    vector<float> y(table.balls.y.begin(), table.balls.y.end());
+    vector<uint32_t> flags(table.balls.flags.begin(), table.balls.flags.end());
+    ShotPreview preview(table);
+    vector<double> cached_ns, prediction_ns;
+
+    for(int r = 0; r < repeats; r++) {
+        for(int a = 0; a < aims; a++) {
+            float angle = -PI/2 + (a - aims/2)*.05f;
+            Vector2<float> velocity = Vector2<float>{cosf(angle), sinf(angle)}*2500.f;
+            auto start = chrono::steady_clock::now();
+            preview.aim(x, y, flags, velocity);
+            while(true) {
+                const ShotPrediction &prediction = preview.latest();
+                if(prediction.velocity == velocity && prediction.complete) break;
+                this_thread::yield();
+            }
+            prediction_ns.push_back(seconds_since(start)*1e9);
+        }
+
+        auto start = chrono::steady_clock::now();
+        for(int f = 0; f < frames; f++) {
+            preview.aim(x, y, flags, {0.f, -2500.f - (f % 8)*.1f});
+        }
+        cached_ns.push_back(seconds_since(start)*1e9/frames);
+    }
+    report->add("preview", "ns_per_cached_aim", median(cached_ns), repeats*frames);
+    report->add("preview", "ms_to_prediction", median(prediction_ns)/1e6, repeats*aims);
+}
+
+// The same spread of breaks one table at a time and as one lockstep
+// batch, on one thread and on every core. Cost is per table tick, so
+// the numbers compare directly however long the shots run.
+void bench_batch(BenchReport *report, int repeats, int tables) {
+    PhysicsWorld table;
+    setup_standard_table(&table, 1);
+    vector<Vector2<float>> shots;
+    for(int t = 0; t < tables; t++) {
+        float angle = -1.5708f + 0.004f*(t - tables/2);
+        shots.push_back({cosf(angle)*2400.f, sinf(angle)*2400.f});
+    }
+
+    vector<double> serial_ns, batch_ns, threaded_ns;
+    long table_ticks = 0;
+    size_t threads = 0;
+    for(int r = 0; r < repeats; r++) {
+        table_ticks = 0;
+        auto start = chrono::steady_clock::now();
+        for(auto &shot : shots) {
+            PhysicsWorld world = table;
+            world.balls.set_velocity(0, shot);
+            world.wake(0);
+            for(int tick = 0; tick < max_ticks && !world.none_moving(); tick++) {
+                world.update(tick_dt);
+                table_ticks++;
+            }
+        }
+        serial_ns.push_back(seconds_since(start)*1e9/table_ticks);
+
+        for(size_t pool_size : {(size_t)1, (size_t)0}) {
+            TableBatch batch(table, tables, pool_size);
+            threads = batch.threads();
+            start = chrono::steady_clock::now();
+            for(int t = 0; t < tables; t++) {
+                batch.shoot(t, shots[t]);
+            }
+            batch.run_to_rest(tick_dt);
+            double ns = seconds_since(start)*1e9/table_ticks;
+            (pool_size == 1 ? batch_ns : threaded_ns).push_back(ns);
+        }
+    }
+
+    string name = "batch_" + to_string(tables);
+    report->add(name + "_serial", "ns_per_table_tick", median(serial_ns), repeats*table_ticks);
+    report->add(name + "_lanes", "ns_per_table_tick", median(batch_ns), repeats*table_ticks);
+    report->add(name + "_lanes_x" + to_string(threads), "ns_per_table_tick", median(threaded_ns), repeats*table_ticks);
+}
+
+// The break under each scalar policy, timed to rest, with how far the
+// final positions end up from the double reference run
+template<class S>
+vector<Vector2<float>> precision_break(double *ns) {
+    PrecisionWorld<S> world(break_table());
+    auto start = chrono::steady_clock::now();
+    for(int tick = 0; tick < max_ticks && !world.none_moving(); tick++) {
+        world.update(tick_dt);
+    }
+    *ns = seconds_since(start)*1e9;
+
+    vector<Vector2<float>> positions;
+    for(size_t i = 0; i < world.size(); i++) {
+        positions.push_back(world.float_position(i));
+    }
+    return positions;
+}
+
+void bench_precision(BenchReport *report, int repeats) {
+    vector<double> float_ns, double_ns, fixed_ns;
+    vector<Vector2<float>> float_end, double_end, fixed_end;
+    for(int r = 0; r < repeats; r++) {
+        double ns;
+        float_end = precision_break<float>(&ns);
+        float_ns.push_back(ns);
+        double_end = precision_break<double>(&ns);
+        double_ns.push_back(ns);
+        fixed_end = precision_break<Fixed>(&ns);
+        fixed_ns.push_back(ns);
+    }
+
+    float float_error = 0.f, fixed_error = 0.f;
+    for(size_t i = 0; i < double_end.size(); i++) {
+        float_error = max(float_error, distance(float_end[i], double_end[i]));
+        fixed_error = max(fixed_error, distance(fixed_end[i], double_end[i]));
+    }
+
+    report->add("precision_float", "ns_per_shot_to_rest", median(float_ns), repeats);
+    report->add("precision_float", "max_distance_from_double", float_error, 1);
+    report->add("precision_double", "ns_per_shot_to_rest", median(double_ns), repeats);
+    report->add("precision_fixed", "ns_per_shot_to_rest", median(fixed_ns), repeats);
+    report->add("precision_fixed", "max_distance_from_double", fixed_error, 1);
+}
+
+// Break recorded to a trajectory file, then random seeks into it
+void bench_replay(BenchReport *report, int repeats) {
+    const char *path = "bench_replay.traj";
+    PhysicsWorld world = break_table();
+    TrajectoryWriter writer;
+    if(!writer.open(path, world.balls.size(), tick_dt)) {
+        printf("replay: could not write %s, skipped\n", path);
+        return;
+    }
+    writer.record_tick(world.balls);
+    for(int tick = 0; tick < max_ticks && !world.none_moving(); tick++) {
+        world.update(tick_dt);
+        writer.record_tick(world.balls);
+    }
+    long bytes = writer.bytes_written();
+    writer.close();
+
+    TrajectoryReader reader;
+    if(!reader.open(path)) return;
+    const int seeks = 10000;
+    mt19937 rng(1);
+    vector<double> seek_ns;
+    for(int r = 0; r < repeats; r++) {
+        auto start = chrono::steady_clock::now();
+        for(int s = 0; s < seeks; s++) {
+            reader.seek(rng() % reader.tick_count());
+        }
+        seek_ns.push_back(seconds_since(start)*1e9/seeks);
+    }
+    long ticks = reader.tick_count();
+    reader.close();
+    remove(path);
+
+    report->add("replay", "bytes_per_tick", (double)bytes/ticks, ticks);
+    report->add("replay", "ns_per_seek", median(seek_ns), repeats*seeks);
+}
+
+#ifdef BENCH_DRAW
+const sf::Color color_order[7] = {
+    sf::Color(227, 211, 36, 255), sf::Color::Blue, sf::Color::Red, sf::Color(76, 17, 171, 255),
+    sf::Color(227, 154, 36, 255), sf::Color(48, 160, 67, 255), sf::Color(148, 30, 30, 255)
+};
+
+vector<BallSprite> bench_sprites(sf::Font *font) {
+    vector<BallSprite> sprites;
+    sprites.push_back(BallSprite(ball_size, false, WHITE, 0, font));
+    for(int i = 1; i <= 7; i++) {
+        sprites.push_back(BallSprite(ball_size, false, color_order[i-1], i, font));
+    }
+    sprites.push_back(BallSprite(ball_size, false, sf::Color::Black, 8, font));
+    for(int i = 1; i <= 7; i++) {
+        sprites.push_back(BallSprite(ball_size, true, color_order[i-1], i+8, font));
+    }
+    return sprites;
+}
+
+// Table and a racked set of balls drawn off-screen, no physics, once
+// with a draw per sprite part and once through the batched atlas
+void bench_draw(BenchReport *report, int repeats) {
+    sf::Font font;
+    sf::Image image;
+    if(!font.loadFromFile("arial.ttf") || !image.loadFromFile("pool_table_nobg.png")) {
+        printf("draw: assets not found, skipped\n");
+        return;
+    }
+
+    PhysicsWorld world;
+    setup_standard_table(&world, 1);
+    Table table = Table({0.f, 0.f}, 1.f, world.pockets, world.pocket_radius,
+                        image.getPixelsPtr(), image.getSize().x, image.getSize().y);
+    vector<BallSprite> sprites = bench_sprites(&font);
+
+    sf::RenderTexture target;
+    target.create(1000, 1000);
+    sf::View view;
+    view.setCenter(0, 0);
+    view.setSize(2000, 2000);
+    target.setView(view);
+
+    BallBatch batch(sprites);
+
+    const int frames = 200;
+    vector<double> frame_ns, batched_ns;
+    for(int r = 0; r < repeats; r++) {
+        auto start = chrono::steady_clock::now();
+        for(int f = 0; f < frames; f++) {
+            target.clear(sf::Color(50, 150, 150, 255));
+            table.draw(&target);
+            for(size_t i = 0; i < world.balls.size(); i++) {
+                sprites[i].draw(&target, world.balls.position(i));
+            }
+            target.display();
+        }
+        frame_ns.push_back(seconds_since(start)*1e9/frames);
+
+        start = chrono::steady_clock::now();
+        for(int f = 0; f < frames; f++) {
+            target.clear(sf::Color(50, 150, 150, 255));
+            table.draw(&target);
+            batch.clear();
+            for(size_t i = 0; i < world.balls.size(); i++) {
+                batch.add(i, world.balls.position(i));
+            }
+            batch.draw(&target);
+            target.display();
+        }
+        batched_ns.push_back(seconds_since(start)*1e9/frames);
+    }
+    report->add("draw", "ns_per_frame", median(frame_ns), repeats*frames);
+    report->add("draw_batched", "ns_per_frame", median(batched_ns), repeats*frames);
+}
+
+// What the viewer does before its first frame: the font, image and ball
+// sprites loaded, decoded and baked, against the same mapped from an
+// asset cache. The file stays in the page cache, as for a viewer
+// started again or many started together.
+void bench_startup(BenchReport *report, int repeats) {
+    const char *path = "bench_assets.cache";
+    PhysicsWorld world;
+    setup_standard_table(&world, 1);
+
+    vector<double> decoded_ns, cached_ns;
+    for(int r = 0; r < repeats; r++) {
+        auto start = chrono::steady_clock::now();
+        sf::Font font;
+        sf::Image image;
+        if(!font.loadFromFile("arial.ttf") || !image.loadFromFile("pool_table_nobg.png")) {
+            printf("startup: assets not found, skipped\n");
+            return;
+        }
+        AssetPixels table_pixels = {image.getPixelsPtr(), image.getSize().x, image.getSize().y};
+        Table table = Table({0.f, 0.f}, 1.f, world.pockets, world.pocket_radius,
+                            table_pixels.pixels, table_pixels.width, table_pixels.height);
+        vector<BallSprite> sprites = bench_sprites(&font);
+        BallBatch batch(sprites);
+        decoded_ns.push_back(seconds_since(start)*1e9);
+
+        sf::Image atlas = batch.atlas_image();
+        if(!write_asset_cache(path, 1, table_pixels, {atlas.getPixelsPtr(), atlas.getSize().x, atlas.getSize().y},
+                              batch.size(), batch.atlas_columns(), batch.atlas_cell(), batch.atlas_scale())) {
+            printf("startup: could not write %s, skipped\n", path);
+            return;
+        }
+
+        start = chrono::steady_clock::now();
+        AssetCache cache;
+        if(!cache.open(path, 1)) break;
+        AssetPixels cached_table = cache.table(), cached_atlas = cache.balls();
+        Table cached = Table({0.f, 0.f}, 1.f, world.pockets, world.pocket_radius,
+                             cached_table.pixels, cached_table.width, cached_table.height);
+        BallBatch cached_batch(cached_atlas.pixels, cached_atlas.width, cached_atlas.height, cache.ball_count(),
+                               cache.atlas_columns(), cache.atlas_cell(), cache.atlas_scale());
+        cache.close();
+        cached_ns.push_back(seconds_since(start)*1e9);
+    }
+    remove(path);
+
+    if(cached_ns.empty()) return;
+    report->add("startup_decoded", "ms_to_assets", median(decoded_ns)/1e6, decoded_ns.size());
+    report->add("startup_cached", "ms_to_assets", median(cached_ns)/1e6, cached_ns.size());
+}
+#endif
+
+string build_description() {
+    string build = "compiler ";
+#ifdef __VERSION__
+    build += __VERSION__;
+#endif
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    build += __builtin_cpu_supports("avx2") ? ", avx2" : ", sse2";
+#endif
+    return build;
+}
+
+int main(int argc, char **argv) {
+    string json_path;
+    int repeats = 5;
+    bool quick = false;
+    vector<string> scenarios;
+    for(int i = 1; i < argc; i++) {
+        if(strcmp(argv[i], "--json") == 0 && i + 1 < argc) json_path = argv[++i];
+        else if(strcmp(argv[i], "--repeats") == 0 && i + 1 < argc) repeats = max(1, atoi(argv[++i]));
+        else if(strcmp(argv[i], "--quick") == 0) quick = true;
+        else if(strcmp(argv[i], "--scenario") == 0 && i + 1 < argc) scenarios.push_back(argv[++i]);
+    }
+
+    // Splits large contact colours, nothing else runs on it
+    ThreadPool contact_pool;
+
+    BenchReport report;
+    bench_break(&report, repeats);
+    for(int balls : {64, 256, 1024, 4096}) {
+        if(quick && balls > 256) break;
+        bench_stress(&report, repeats, balls);
+    }
+    for(auto &path : scenarios) {
+        bench_scenario(&report, repeats, path, &contact_pool);
+    }
+    bench_contacts(&report, repeats);
+    bench_contact_pool(&report, repeats, &contact_pool);
+    bench_sub_steps(&report, repeats);
+    bench_bank(&report, repeats);
+    bench_replay(&report, repeats);
+    bench_precision(&report, repeats);
+    bench_clone(&report, repeats);
+    bench_rollback(&report, repeats);
+    bench_preview(&report, repeats);
+    bench_batch(&report, repeats, quick ? 64 : 512);
+#ifdef BENCH_DRAW
+    bench_draw(&report, repeats);
+    bench_startup(&report, repeats);
+#endif
+
+    if(!json_path.empty() && !report.write_json(json_path, build_description())) {
+        fprintf(stderr, "could not write %s\n", json_path.c_str());
+        return 1;
+    }
+    return 0;
+}
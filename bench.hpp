@@ -0,0 +1,57 @@
+#include <vector>
+#include <string>
+#include <chrono>
+#include <algorithm>
+#include <functional>
+#include <cstdio>
+
+#pragma once
+
+using namespace std;
+
+// Small harness shared by the benchmark programs: every scenario reports
+// named metrics, each the median of several repeats, and the whole run
+// can be written as JSON to compare builds against each other.
+
+struct BenchResult {
+    string scenario;
+    string metric;
+    double value;
+    long   samples;
+};
+
+class BenchReport {
+    public:
+    vector<BenchResult> results;
+
+    void add(const string &scenario, const string &metric, double value, long samples) {
+        results.push_back({scenario, metric, value, samples});
+        printf("%-24s %-26s %16.3f  (%ld samples)\n", scenario.c_str(), metric.c_str(), value, samples);
+    }
+
+    bool write_json(const string &path, const string &build) const {
+        FILE *file = path == "-" ? stdout : fopen(path.c_str(), "w");
+        if(!file) return false;
+
+        fprintf(file, "{\n  \"format\": 1,\n  \"build\": \"%s\",\n  \"results\": [\n", build.c_str());
+        for(size_t i = 0; i < results.size(); i++) {
+            const BenchResult &r = results[i];
+            fprintf(file, "    {\"scenario\": \"%s\", \"metric\": \"%s\", \"value\": %.3f, \"samples\": %ld}%s\n",
+                r.scenario.c_str(), r.metric.c_str(), r.value, r.samples, i + 1 < results.size() ? "," : "");
+        }
+        fprintf(file, "  ]\n}\n");
+
+        if(file != stdout) fclose(file);
+        return true;
+    }
+};
+
+inline double seconds_since(chrono::steady_clock::time_point start) {
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+inline double median(vector<double> values) {
+    if(values.empty()) return 0;
+    sort(values.begin(), values.end());
+    return values[values.size()/2];
+}
@@ -0,0 +1,77 @@
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include "physics.hpp"
+
+using namespace std;
+
+// Times one collision pass (broad phase plus narrow phase) on stress
+// fields of growing size and reports where each broad phase starts to
+// beat the brute-force loop.
+//
+//   ./bench_broadphase [max_balls]
+
+const float bench_dt = 1.f/60.f/sub_updates;
+const double min_seconds = 0.2;
+
+const char *broad_phase_names[] = {"brute", "grid", "sweep"};
+
+double ns_per_pass(const PhysicsWorld &start, broad_phase_type type) {
+    PhysicsWorld world = start;
+    world.set_broad_phase(type);
+
+    long passes = 0;
+    double elapsed = 0;
+    auto begin = chrono::steady_clock::now();
+    while(elapsed < min_seconds) {
+        // Time the collision pass only, the balls still move between passes
+        world.sub_update(bench_dt);
+        auto pass_begin = chrono::steady_clock::now();
+        world.ball_to_ball_collision();
+        auto pass_end = chrono::steady_clock::now();
+
+        elapsed += chrono::duration<double>(pass_end - pass_begin).count();
+        passes++;
+        if(chrono::duration<double>(pass_end - begin).count() > 10*min_seconds) break;
+    }
+    return elapsed*1e9/passes;
+}
+
+int main(int argc, char **argv) {
+    int max_balls = argc > 1 ? atoi(argv[1]) : 4096;
+    int crossover[3] = {0, 0, 0};
+
+    printf("%8s %14s %14s %14s\n", "balls", "brute ns", "grid ns", "sweep ns");
+    for(int balls = 16; balls <= max_balls; balls *= 2) {
+        PhysicsWorld world;
+        generate_stress_field(&world, balls, stress_table_scale(balls), 1);
+
+        // Let the field settle into collisions before timing
+        for(int i = 0; i < 4*sub_updates; i++) {
+            world.sub_update(bench_dt);
+            world.ball_to_ball_collision();
+            world.check_ball_line_collision();
+        }
+
+        double ns[3];
+        for(int type = BRUTE_FORCE; type <= SWEEP_AND_PRUNE; type++) {
+            ns[type] = ns_per_pass(world, (broad_phase_type)type);
+        }
+        printf("%8d %14.0f %14.0f %14.0f\n", balls, ns[BRUTE_FORCE], ns[UNIFORM_GRID], ns[SWEEP_AND_PRUNE]);
+
+        for(int type = UNIFORM_GRID; type <= SWEEP_AND_PRUNE; type++) {
+            if(!crossover[type] && ns[type] < ns[BRUTE_FORCE]) crossover[type] = balls;
+        }
+    }
+
+    for(int type = UNIFORM_GRID; type <= SWEEP_AND_PRUNE; type++) {
+        if(crossover[type]) {
+            printf("%s beats brute force from %d balls\n", broad_phase_names[type], crossover[type]);
+        }
+        else {
+            printf("%s never beats brute force up to %d balls\n", broad_phase_names[type], max_balls);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,81 @@
+#include <stddef.h>
+#include <stdint.h>
+
+#pragma once
+
+/* C interface to the physics, for hosts that cannot use the C++ classes
+ * (Python through ctypes or cffi, training harnesses, other languages).
+ * Built as a shared library with `make shared`.
+ *
+ * Balls are numbered as in the game, 0 is the cue ball. State is copied
+ * into buffers the caller owns, one call for the whole table, laid out
+ * so a NumPy array can be passed straight in:
+ *
+ *   positions, velocities  ball_count x 2 floats, x then y per ball
+ *   pockets                ball_count int8, pocket index or -1 on the table
+ *
+ * Functions that can fail return one of billiards_status. Nothing here
+ * keeps global state, separate worlds may be used from separate threads.
+ */
+
+#ifdef _WIN32
+#ifdef BILLIARDS_BUILD
+#define BILLIARDS_API __declspec(dllexport)
+#else
+#define BILLIARDS_API __declspec(dllimport)
+#endif
+#else
+#define BILLIARDS_API __attribute__((visibility("default")))
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Bumped whenever a signature or buffer layout changes */
+#define BILLIARDS_API_VERSION 1
+
+typedef enum {
+    BILLIARDS_OK = 0,
+    /* A null world or buffer, or a buffer too small for every ball */
+    BILLIARDS_INVALID = -1,
+    /* Shots need every ball at rest and the cue ball on the table */
+    BILLIARDS_BUSY = -2,
+    /* Ran out of memory part way, the world should be destroyed */
+    BILLIARDS_NO_MEMORY = -3
+} billiards_status;
+
+typedef struct billiards_world billiards_world;
+
+BILLIARDS_API int billiards_api_version(void);
+
+/* A standard table racked with billiards_rack(seed), NULL if out of memory */
+BILLIARDS_API billiards_world *billiards_create(unsigned seed);
+BILLIARDS_API void billiards_destroy(billiards_world *world);
+
+/* Fresh rack, the same seed always gives the same triangle */
+BILLIARDS_API int billiards_rack(billiards_world *world, unsigned seed);
+
+BILLIARDS_API size_t billiards_ball_count(const billiards_world *world);
+BILLIARDS_API size_t billiards_pocket_count(const billiards_world *world);
+
+/* Hits the cue ball, velocity in table units per second */
+BILLIARDS_API int billiards_shoot(billiards_world *world, float vx, float vy);
+/* Puts a pocketed cue ball back on its spot */
+BILLIARDS_API int billiards_respot_cue(billiards_world *world);
+
+/* One tick of dt seconds, split into sub-steps as in the game */
+BILLIARDS_API int billiards_step(billiards_world *world, float dt);
+/* Ticks until every ball rests or max_ticks pass, returns ticks run or
+ * a negative billiards_status */
+BILLIARDS_API long billiards_run_to_rest(billiards_world *world, float dt, long max_ticks);
+BILLIARDS_API int billiards_at_rest(const billiards_world *world);
+
+/* Copies the state of every ball, any buffer may be NULL to skip it.
+ * capacity is the number of balls each buffer has room for. */
+BILLIARDS_API int billiards_read_state(const billiards_world *world, float *positions, float *velocities,
+                                       int8_t *pockets, size_t capacity);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,129 @@
+#include <new>
+#include "billiards.h"
+#include "physics.hpp"
+
+using namespace std;
+
+// The handle is the world itself, nothing else needs to live beside it.
+// No exception may cross into C, anything that can allocate catches.
+
+struct billiards_world {
+    PhysicsWorld world;
+};
+
+int billiards_api_version(void) {
+    return BILLIARDS_API_VERSION;
+}
+
+billiards_world *billiards_create(unsigned seed) {
+    billiards_world *handle = new(nothrow) billiards_world;
+    if(!handle) return NULL;
+    try {
+        setup_standard_table(&handle->world, seed);
+    }
+    catch(...) {
+        delete handle;
+        return NULL;
+    }
+    return handle;
+}
+
+void billiards_destroy(billiards_world *handle) {
+    delete handle;
+}
+
+int billiards_rack(billiards_world *handle, unsigned seed) {
+    if(!handle) return BILLIARDS_INVALID;
+    try {
+        handle->world.rack(seed);
+    }
+    catch(...) {
+        return BILLIARDS_NO_MEMORY;
+    }
+    return BILLIARDS_OK;
+}
+
+size_t billiards_ball_count(const billiards_world *handle) {
+    return handle ? handle->world.balls.size() : 0;
+}
+
+size_t billiards_pocket_count(const billiards_world *handle) {
+    return handle ? handle->world.pockets.size() : 0;
+}
+
+int billiards_shoot(billiards_world *handle, float vx, float vy) {
+    if(!handle) return BILLIARDS_INVALID;
+    PhysicsWorld &world = handle->world;
+    if(!world.none_moving() || world.balls.is_pocketed(0)) return BILLIARDS_BUSY;
+
+    try {
+        world.balls.set_velocity(0, {vx, vy});
+        world.wake(0);
+    }
+    catch(...) {
+        return BILLIARDS_NO_MEMORY;
+    }
+    return BILLIARDS_OK;
+}
+
+int billiards_respot_cue(billiards_world *handle) {
+    if(!handle) return BILLIARDS_INVALID;
+    if(!handle->world.none_moving()) return BILLIARDS_BUSY;
+    try {
+        handle->world.respot_ball(0, {0, line_distance});
+    }
+    catch(...) {
+        return BILLIARDS_NO_MEMORY;
+    }
+    return BILLIARDS_OK;
+}
+
+int billiards_step(billiards_world *handle, float dt) {
+    if(!handle || !(dt > 0.f)) return BILLIARDS_INVALID;
+    try {
+        handle->world.update(dt);
+    }
+    catch(...) {
+        return BILLIARDS_NO_MEMORY;
+    }
+    return BILLIARDS_OK;
+}
+
+long billiards_run_to_rest(billiards_world *handle, float dt, long max_ticks) {
+    if(!handle || !(dt > 0.f)) return BILLIARDS_INVALID;
+    long ticks = 0;
+    try {
+        while(ticks < max_ticks && !handle->world.none_moving()) {
+            handle->world.update(dt);
+            ticks++;
+        }
+    }
+    catch(...) {
+        return BILLIARDS_NO_MEMORY;
+    }
+    return ticks;
+}
+
+int billiards_at_rest(const billiards_world *handle) {
+    return handle ? handle->world.none_moving() : 1;
+}
+
+int billiards_read_state(const billiards_world *handle, float *positions, float *velocities,
+                         int8_t *pockets, size_t capacity) {
+    if(!handle) return BILLIARDS_INVALID;
+    const BallStore &balls = handle->world.balls;
+    if(capacity < balls.size()) return BILLIARDS_INVALID;
+
+    for(size_t i = 0; i < balls.size(); i++) {
+        if(positions) {
+            positions[2*i] = balls.x[i];
+            positions[2*i + 1] = balls.y[i];
+        }
+        if(velocities) {
+            velocities[2*i] = balls.vx[i];
+            velocities[2*i + 1] = balls.vy[i];
+        }
+        if(pockets) pockets[i] = balls.pocket[i];
+    }
+    return BILLIARDS_OK;
+}
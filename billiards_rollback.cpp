@@ -0,0 +1,165 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <algorithm>
+#include "rollback.hpp"
+#include "scenario.hpp"
+
+using namespace std;
+
+// Two rollback sessions in one process talking over a simulated link,
+// to see rollback stay inside the frame budget and both sides agree.
+//
+//   billiards-rollback [--frames <n>] [--latency <ms>] [--jitter <ms>] [--max-rollback <frames>]
+//                      [--tick-rate <hz>] [--shot-every <frames>] [--seed <n>] [--scenario <file>]
+//
+// Each packet takes latency plus or minus up to jitter, so packets also
+// overtake each other. The players take turns shooting every shot-every
+// frames. A third session gets every input on time and is the reference
+// both sides have to end up bitwise equal to. Exits 1 when they do not,
+// or when an advance() ran over the frame budget.
+
+struct Packet {
+    double        arrival_ms;
+    int           to;
+    RollbackInput input;
+};
+
+// The scripted input of one player for one frame
+RollbackInput scripted_input(long frame, int player, int shot_every, unsigned seed) {
+    RollbackInput input = {(uint32_t)frame, (uint8_t)player, 0, {0.f, 0.f}};
+    if(frame % shot_every != 0 || (frame/shot_every) % 2 != player) return input;
+
+    mt19937 rng(seed*7919u + frame);
+    float angle = uniform_real_distribution<float>(0.f, 2.f*PI)(rng);
+    float speed = uniform_real_distribution<float>(800.f, 3000.f)(rng);
+    input.shoot = 1;
+    input.velocity = {cosf(angle)*speed, sinf(angle)*speed};
+    return input;
+}
+
+double percentile(vector<double> values, double fraction) {
+    if(values.empty()) return 0;
+    size_t k = min(values.size() - 1, (size_t)(fraction*values.size()));
+    nth_element(values.begin(), values.begin() + k, values.end());
+    return values[k];
+}
+
+int usage() {
+    fprintf(stderr, "usage: billiards-rollback [--frames n] [--latency ms] [--jitter ms] [--max-rollback frames]\n"
+                    "                          [--tick-rate hz] [--shot-every frames] [--seed n] [--scenario file]\n");
+    return 2;
+}
+
+int main(int argc, char **argv) {
+    long     frames       = 120*60;
+    double   latency_ms   = 50;
+    double   jitter_ms    = 20;
+    int      max_rollback = 16;
+    float    tick_rate    = default_tick_rate;
+    int      shot_every   = 240;
+    unsigned seed         = 1;
+    string   scenario_path;
+    for(int i = 1; i < argc; i++) {
+        if(strcmp(argv[i], "--frames") == 0 && i + 1 < argc) frames = max(1L, atol(argv[++i]));
+        else if(strcmp(argv[i], "--latency") == 0 && i + 1 < argc) latency_ms = max(0., atof(argv[++i]));
+        else if(strcmp(argv[i], "--jitter") == 0 && i + 1 < argc) jitter_ms = max(0., atof(argv[++i]));
+        else if(strcmp(argv[i], "--max-rollback") == 0 && i + 1 < argc) max_rollback = max(0, atoi(argv[++i]));
+        else if(strcmp(argv[i], "--tick-rate") == 0 && i + 1 < argc) tick_rate = max(1.f, (float)atof(argv[++i]));
+        else if(strcmp(argv[i], "--shot-every") == 0 && i + 1 < argc) shot_every = max(1, atoi(argv[++i]));
+        else if(strcmp(argv[i], "--seed") == 0 && i + 1 < argc) seed = strtoul(argv[++i], nullptr, 10);
+        else if(strcmp(argv[i], "--scenario") == 0 && i + 1 < argc) scenario_path = argv[++i];
+        else return usage();
+    }
+
+    PhysicsWorld world;
+    if(!scenario_path.empty()) {
+        float scale;
+        string error;
+        if(!load_scenario(scenario_path, &world, &scale, &error)) {
+            fprintf(stderr, "%s: %s\n", scenario_path.c_str(), error.c_str());
+            return 1;
+        }
+    }
+    else {
+        setup_standard_table(&world, seed);
+    }
+
+    // Reference, every input on time
+    RollbackSession reference(world, 2, 0, tick_rate);
+    for(long frame = 0; frame < frames; frame++) {
+        for(int p = 0; p < 2; p++) {
+            reference.add_input(scripted_input(frame, p, shot_every, seed));
+        }
+        reference.advance();
+    }
+
+    RollbackSession peer0(world, 2, max_rollback, tick_rate), peer1(world, 2, max_rollback, tick_rate);
+    RollbackSession *peers[2] = {&peer0, &peer1};
+    vector<Packet> in_flight;
+    mt19937 link(seed);
+    uniform_real_distribution<double> jitter(-jitter_ms, jitter_ms);
+
+    double frame_ms = 1000./tick_rate;
+    vector<double> advance_us;
+    long stalls[2] = {0, 0};
+    advance_us.reserve(2*frames);
+
+    // Both sides tick on the same simulated clock, the link delivers what
+    // has arrived by then
+    for(long tick = 0; peer0.frame() < frames || peer1.frame() < frames || !in_flight.empty(); tick++) {
+        double now_ms = tick*frame_ms;
+        auto arrived = partition(in_flight.begin(), in_flight.end(), [now_ms](const Packet &packet) {
+            return packet.arrival_ms > now_ms;
+        });
+        for(auto it = arrived; it != in_flight.end(); it++) {
+            peers[it->to]->add_input(it->input);
+        }
+        in_flight.erase(arrived, in_flight.end());
+
+        for(int p = 0; p < 2; p++) {
+            RollbackSession *peer = peers[p];
+            if(peer->frame() >= frames) continue;
+            if(!peer->can_advance()) {
+                stalls[p]++;
+                continue;
+            }
+
+            RollbackInput input = scripted_input(peer->frame(), p, shot_every, seed);
+            peer->add_input(input);
+            in_flight.push_back({now_ms + max(0., latency_ms + jitter(link)), 1 - p, input});
+
+            auto start = chrono::steady_clock::now();
+            peer->advance();
+            advance_us.push_back(chrono::duration<double, micro>(chrono::steady_clock::now() - start).count());
+        }
+    }
+    // The last inputs may have come in after the last frame ran
+    for(RollbackSession *peer : peers) {
+        auto start = chrono::steady_clock::now();
+        peer->resimulate();
+        advance_us.push_back(chrono::duration<double, micro>(chrono::steady_clock::now() - start).count());
+    }
+
+    uint64_t expected = reference.state().state_hash();
+    bool agree = peer0.state().state_hash() == expected && peer1.state().state_hash() == expected;
+    double worst_us = percentile(advance_us, 1.);
+    bool in_budget = worst_us <= frame_ms*1000.;
+
+    printf("%ld frames at %g Hz, latency %g ms +- %g ms, max rollback %d frames, %zu-byte state\n",
+           frames, tick_rate, latency_ms, jitter_ms, max_rollback, world.state_size());
+    for(int p = 0; p < 2; p++) {
+        RollbackStats stats = peers[p]->stats();
+        printf("peer %d: %ld rollbacks, %ld frames resimulated, deepest %ld, %ld stalled ticks\n",
+               p, stats.rollbacks, stats.frames_resimulated, stats.deepest, stalls[p]);
+    }
+    printf("advance: p50 %.1f us, p99 %.1f us, max %.1f us, budget %.1f us, %s\n",
+           percentile(advance_us, .5), percentile(advance_us, .99), worst_us, frame_ms*1000., in_budget ? "within" : "OVER");
+    printf("state %016llx, reference %016llx, %s\n", (unsigned long long)peer0.state().state_hash(),
+           (unsigned long long)expected, agree ? "agree" : "DESYNC");
+    return agree && in_budget ? 0 : 1;
+}
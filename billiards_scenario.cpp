@@ -0,0 +1,91 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include "physics.hpp"
+#include "scenario.hpp"
+
+using namespace std;
+
+// Writes and checks scenario files, see scenario.hpp for the format.
+//
+//   billiards-scenario standard <file> [seed]
+//   billiards-scenario generate <file> [--balls <n>] [--scale <s>] [--seed <n>]
+//                      [--speed <max>] [--radius <min> <max>] [--mass <min> <max>]
+//   billiards-scenario info <file>
+//
+// generate makes synthetic tables for scaling runs, e.g. ten times the
+// standard table with 5000 balls: generate big.scn --scale 10 --balls 5000.
+// The results go through `bench --scenario <file>` or `main --scenario <file>`.
+
+int usage() {
+    fprintf(stderr, "usage: billiards-scenario standard <file> [seed]\n"
+                    "       billiards-scenario generate <file> [--balls n] [--scale s] [--seed n] [--speed max]\n"
+                    "                          [--radius min max] [--mass min max]\n"
+                    "       billiards-scenario info <file>\n");
+    return 2;
+}
+
+int main(int argc, char **argv) {
+    if(argc < 3) return usage();
+    string path = argv[2];
+    PhysicsWorld world;
+
+    if(strcmp(argv[1], "standard") == 0) {
+        setup_standard_table(&world, argc > 3 ? strtoul(argv[3], nullptr, 10) : 1);
+        if(!save_scenario(path, world, 1.f)) {
+            fprintf(stderr, "could not write %s\n", path.c_str());
+            return 1;
+        }
+        return 0;
+    }
+
+    if(strcmp(argv[1], "generate") == 0) {
+        SyntheticSpec spec = {1.f, 1000, 1, 400.f, (float)ball_size, (float)ball_size, (float)ball_mass, (float)ball_mass};
+        for(int i = 3; i < argc; i++) {
+            if(strcmp(argv[i], "--balls") == 0 && i + 1 < argc) spec.ball_count = max(0, atoi(argv[++i]));
+            else if(strcmp(argv[i], "--scale") == 0 && i + 1 < argc) spec.scale = atof(argv[++i]);
+            else if(strcmp(argv[i], "--seed") == 0 && i + 1 < argc) spec.seed = strtoul(argv[++i], nullptr, 10);
+            else if(strcmp(argv[i], "--speed") == 0 && i + 1 < argc) spec.max_speed = atof(argv[++i]);
+            else if(strcmp(argv[i], "--radius") == 0 && i + 2 < argc) {
+                spec.min_radius = atof(argv[++i]);
+                spec.max_radius = atof(argv[++i]);
+            }
+            else if(strcmp(argv[i], "--mass") == 0 && i + 2 < argc) {
+                spec.min_mass = atof(argv[++i]);
+                spec.max_mass = atof(argv[++i]);
+            }
+            else return usage();
+        }
+        if(!(spec.min_radius > 0 && spec.max_radius >= spec.min_radius && spec.min_mass > 0 && spec.max_mass >= spec.min_mass)) {
+            return usage();
+        }
+
+        float scale = generate_synthetic_table(&world, spec);
+        if(scale != spec.scale) printf("scale raised to %.3g to fit %d balls\n", scale, spec.ball_count);
+        if(!save_scenario(path, world, scale)) {
+            fprintf(stderr, "could not write %s\n", path.c_str());
+            return 1;
+        }
+        return 0;
+    }
+
+    if(strcmp(argv[1], "info") == 0) {
+        float scale;
+        string error;
+        auto start = chrono::steady_clock::now();
+        if(!load_scenario(path, &world, &scale, &error)) {
+            fprintf(stderr, "%s: %s\n", path.c_str(), error.c_str());
+            return 1;
+        }
+        double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        size_t moving = 0;
+        for(size_t i = 0; i < world.balls.size(); i++) {
+            moving += world.balls.is_moving(i);
+        }
+        printf("%s: %zu balls (%zu moving), %zu cushions, %zu pockets, table scale %g, loaded in %.2f ms\n", path.c_str(),
+               world.balls.size(), moving, world.lines.size(), world.pockets.size(), scale, ms);
+        return 0;
+    }
+    return usage();
+}
@@ -0,0 +1,261 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <memory>
+#include "game_server.hpp"
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+// billiards-server runs many games in one process, driven by one text
+// command per line on stdin or from clients on a local socket. Replies
+// go back to whoever sent the command, "done" lines come later, once a
+// shot's balls rest, in whatever order the shots finish.
+//
+//   new [seed]            game <id>
+//   shoot <id> <vx> <vy>  queued <id> <depth>
+//                         then done <id> <shot> ticks <n> pocketed <balls|-> [scratch] [stopped] latency_ms <ms>
+//                         or dropped <id> <shot> latency_ms <ms> while balls roll or the cue ball is down
+//   rack <id> <seed>      ok, between shots only
+//   state <id>            state <id> then x y pocket for every ball
+//   close <id>            ok
+//   stats                 stats ... since the last stats
+//   quit                  ends the connection, or the server on stdin
+//
+// Anything else gets "error <why>". On stdin the server finishes every
+// queued shot at end of input, so a file of commands can be piped in.
+
+// Where one client's replies go, shared with the games it created
+struct Client {
+    // -1 for stdout
+    int          fd;
+    bool         open;
+    mutex        lock;
+    vector<long> games;
+
+    void send(const string &line) {
+        lock_guard<mutex> guard(lock);
+        if(!open) return;
+        string out = line + "\n";
+        if(fd < 0) {
+            fwrite(out.data(), 1, out.size(), stdout);
+            fflush(stdout);
+            return;
+        }
+#ifndef _WIN32
+        size_t sent = 0;
+        while(sent < out.size()) {
+            ssize_t n = ::send(fd, out.data() + sent, out.size() - sent, MSG_NOSIGNAL);
+            if(n <= 0) {
+                open = false;
+                return;
+            }
+            sent += n;
+        }
+#endif
+    }
+};
+
+string format_stats(const ServerStats &stats) {
+    char line[320];
+    snprintf(line, sizeof(line), "stats games %zu queued_shots %ld run_queue %zu sim_seconds_per_sec %.1f ticks_per_sec %.0f "
+             "shots_per_sec %.1f latency_ms p50 %.3f p90 %.3f p99 %.3f max %.3f",
+             stats.games, stats.queued_shots, stats.run_queue, stats.sim_seconds_per_sec, stats.ticks_per_sec,
+             stats.shots_per_sec, stats.latency_p50_ms, stats.latency_p90_ms, stats.latency_p99_ms, stats.latency_max_ms);
+    return line;
+}
+
+// False once the client asked to quit
+bool handle(GameServer *server, const shared_ptr<Client> &client, const char *line) {
+    char command[16] = "";
+    long id = 0;
+    unsigned seed = 0;
+    float vx = 0, vy = 0;
+    if(sscanf(line, "%15s", command) != 1) return true;
+
+    if(strcmp(command, "new") == 0) {
+        if(sscanf(line, "%*s %u", &seed) != 1) seed = rand();
+        id = server->create(seed, [client](const string &reply) {
+            client->send(reply);
+        });
+        client->games.push_back(id);
+        client->send("game " + to_string(id));
+    }
+    else if(strcmp(command, "shoot") == 0) {
+        if(sscanf(line, "%*s %ld %f %f", &id, &vx, &vy) != 3) {
+            client->send("error usage: shoot <id> <vx> <vy>");
+            return true;
+        }
+        if(!isfinite(vx) || !isfinite(vy)) {
+            client->send("error velocity not finite");
+            return true;
+        }
+        long depth = server->shoot(id, {vx, vy});
+        client->send(depth < 0 ? "error no game " + to_string(id) : "queued " + to_string(id) + " " + to_string(depth));
+    }
+    else if(strcmp(command, "rack") == 0) {
+        if(sscanf(line, "%*s %ld %u", &id, &seed) != 2) {
+            client->send("error usage: rack <id> <seed>");
+            return true;
+        }
+        client->send(server->rack(id, seed) ? "ok" : "error game " + to_string(id) + " missing or busy");
+    }
+    else if(strcmp(command, "state") == 0) {
+        string balls;
+        sscanf(line, "%*s %ld", &id);
+        client->send(server->describe(id, &balls) ? "state " + to_string(id) + " " + balls : "error no game " + to_string(id));
+    }
+    else if(strcmp(command, "close") == 0) {
+        sscanf(line, "%*s %ld", &id);
+        client->send(server->close(id) ? "ok" : "error no game " + to_string(id));
+    }
+    else if(strcmp(command, "stats") == 0) {
+        client->send(format_stats(server->stats()));
+    }
+    else if(strcmp(command, "quit") == 0) {
+        return false;
+    }
+    else {
+        client->send(string("error unknown command ") + command);
+    }
+    return true;
+}
+
+#ifndef _WIN32
+// One thread per connection, its games close with it
+void serve_client(GameServer *server, int fd) {
+    auto client = make_shared<Client>();
+    client->fd = fd;
+    client->open = true;
+
+    string pending;
+    char buffer[4096];
+    bool going = true;
+    while(going) {
+        ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+        if(n <= 0) break;
+        pending.append(buffer, n);
+        size_t start = 0, end;
+        while(going && (end = pending.find('\n', start)) != string::npos) {
+            pending[end] = 0;
+            going = handle(server, client, pending.c_str() + start);
+            start = end + 1;
+        }
+        pending.erase(0, start);
+    }
+
+    for(long id : client->games) {
+        server->close(id);
+    }
+    {
+        lock_guard<mutex> guard(client->lock);
+        client->open = false;
+    }
+    ::close(fd);
+}
+
+int serve_socket(GameServer *server, const string &path) {
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if(listener < 0 || path.size() >= sizeof(address.sun_path)) {
+        fprintf(stderr, "could not open socket %s\n", path.c_str());
+        return 1;
+    }
+    strcpy(address.sun_path, path.c_str());
+    unlink(path.c_str());
+    if(bind(listener, (sockaddr *)&address, sizeof(address)) != 0 || listen(listener, 64) != 0) {
+        fprintf(stderr, "could not listen on %s\n", path.c_str());
+        return 1;
+    }
+    fprintf(stderr, "listening on %s, %zu workers\n", path.c_str(), server->threads());
+
+    while(true) {
+        int fd = accept(listener, nullptr, nullptr);
+        if(fd < 0) continue;
+        thread(serve_client, server, fd).detach();
+    }
+}
+#endif
+
+// Prints stats every few seconds until it goes out of scope, which has
+// to be before the server does
+class StatsReporter {
+    private:
+    mutex              lock;
+    condition_variable wake;
+    bool               stopping;
+    thread             worker;
+
+    public:
+    StatsReporter(GameServer *server, float every) {
+        stopping = false;
+        worker = thread([this, server, every] {
+            unique_lock<mutex> guard(lock);
+            while(!wake.wait_for(guard, chrono::duration<float>(every), [this] { return stopping; })) {
+                fprintf(stderr, "%s\n", format_stats(server->stats()).c_str());
+            }
+        });
+    }
+
+    ~StatsReporter() {
+        {
+            lock_guard<mutex> guard(lock);
+            stopping = true;
+        }
+        wake.notify_one();
+        worker.join();
+    }
+};
+
+int main(int argc, char **argv) {
+    // Worker threads, 0 for one per core: --threads <n>
+    // Commands from clients on a Unix socket instead of stdin: --socket <path>
+    // Stats on stderr every few seconds: --stats <seconds>
+    // Physics ticks per second: --tick-rate <hz>
+    size_t threads   = 0;
+    string socket_path;
+    float  stats_every = 0;
+    float  tick_rate = default_tick_rate;
+    for(int i = 1; i < argc; i++) {
+        if(strcmp(argv[i], "--threads") == 0 && i + 1 < argc) threads = atoi(argv[i+1]);
+        if(strcmp(argv[i], "--socket") == 0 && i + 1 < argc) socket_path = argv[i+1];
+        if(strcmp(argv[i], "--stats") == 0 && i + 1 < argc) stats_every = atof(argv[i+1]);
+        if(strcmp(argv[i], "--tick-rate") == 0 && i + 1 < argc) tick_rate = max(1.f, (float)atof(argv[i+1]));
+    }
+
+    GameServer server(threads, tick_rate);
+    unique_ptr<StatsReporter> reporter;
+    if(stats_every > 0) reporter = make_unique<StatsReporter>(&server, stats_every);
+
+    if(!socket_path.empty()) {
+#ifndef _WIN32
+        return serve_socket(&server, socket_path);
+#else
+        fprintf(stderr, "--socket needs Unix sockets, use stdin here\n");
+        return 1;
+#endif
+    }
+
+    auto client = make_shared<Client>();
+    client->fd = -1;
+    client->open = true;
+    char line[256];
+    while(fgets(line, sizeof(line), stdin) && handle(&server, client, line)) {
+    }
+
+    server.wait_idle();
+    fprintf(stderr, "%s\n", format_stats(server.stats()).c_str());
+    return 0;
+}
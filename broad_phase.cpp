@@ -0,0 +1,177 @@
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include "broad_phase.hpp"
+
+using namespace std;
+
+static bool boxes_overlap(const BallStore *balls, uint32_t i, uint32_t j) {
+    float reach = balls->radius[i] + balls->radius[j];
+    return fabsf(balls->x[i] - balls->x[j]) <= reach && fabsf(balls->y[i] - balls->y[j]) <= reach;
+}
+
+static bool pair_order(const BallPair &a, const BallPair &b) {
+    return a.i != b.i ? a.i < b.i : a.j < b.j;
+}
+
+// Brute force
+
+void BruteForce::find_pairs(const BallStore *balls, vector<BallPair> *pairs) {
+    pairs->clear();
+    uint32_t n = balls->size();
+    for(uint32_t i = 0; i < n; i++) {
+        for(uint32_t j = 0; j < i; j++) {
+            if(boxes_overlap(balls, i, j)) {
+                pairs->push_back({i, j});
+            }
+        }
+    }
+}
+
+unique_ptr<BroadPhase> BruteForce::clone() const {
+    return make_unique<BruteForce>(*this);
+}
+
+// Uniform grid
+
+static uint32_t cell_hash(int32_t x, int32_t y, uint32_t mask) {
+    return ((uint32_t)x*73856093u ^ (uint32_t)y*19349663u) & mask;
+}
+
+static int32_t cell_of(float position, float inverse_cell_size) {
+    float cell = floorf(position*inverse_cell_size);
+    cell = max(-1e9f, min(1e9f, cell));
+    return (int32_t)cell;
+}
+
+void UniformGrid::find_pairs(const BallStore *balls, vector<BallPair> *pairs) {
+    pairs->clear();
+    uint32_t n = balls->size();
+    if(n == 0) return;
+
+    float max_radius = 0.f;
+    for(float r : balls->radius) {
+        max_radius = max(max_radius, r);
+    }
+    float inverse_cell_size = 1.f/(2.f*max_radius);
+
+    uint32_t bucket_count = 1;
+    while(bucket_count < 2*n) bucket_count <<= 1;
+    uint32_t mask = bucket_count - 1;
+
+    cell_x.resize(n);
+    cell_y.resize(n);
+    bucket_of.resize(n);
+    sorted.resize(n);
+    bucket_start.assign(bucket_count + 1, 0);
+
+    // Counting sort of ball indices by bucket
+    for(uint32_t i = 0; i < n; i++) {
+        cell_x[i] = cell_of(balls->x[i], inverse_cell_size);
+        cell_y[i] = cell_of(balls->y[i], inverse_cell_size);
+        bucket_of[i] = cell_hash(cell_x[i], cell_y[i], mask);
+        bucket_start[bucket_of[i] + 1]++;
+    }
+    for(uint32_t b = 0; b < bucket_count; b++) {
+        bucket_start[b + 1] += bucket_start[b];
+    }
+    for(uint32_t i = 0; i < n; i++) {
+        sorted[bucket_start[bucket_of[i]]++] = i;
+    }
+    for(uint32_t b = bucket_count; b > 0; b--) {
+        bucket_start[b] = bucket_start[b - 1];
+    }
+    bucket_start[0] = 0;
+
+    for(uint32_t i = 0; i < n; i++) {
+        size_t first = pairs->size();
+        for(int32_t dy = -1; dy <= 1; dy++) {
+            for(int32_t dx = -1; dx <= 1; dx++) {
+                int32_t x = cell_x[i] + dx;
+                int32_t y = cell_y[i] + dy;
+                uint32_t bucket = cell_hash(x, y, mask);
+                for(uint32_t k = bucket_start[bucket]; k < bucket_start[bucket + 1]; k++) {
+                    uint32_t j = sorted[k];
+                    // Skip later balls and other cells sharing this bucket
+                    if(j >= i || cell_x[j] != x || cell_y[j] != y) continue;
+                    if(boxes_overlap(balls, i, j)) {
+                        pairs->push_back({i, j});
+                    }
+                }
+            }
+        }
+        sort(pairs->begin() + first, pairs->end(), pair_order);
+    }
+}
+
+unique_ptr<BroadPhase> UniformGrid::clone() const {
+    return make_unique<UniformGrid>(*this);
+}
+
+// Sweep and prune
+
+void SweepAndPrune::find_pairs(const BallStore *balls, vector<BallPair> *pairs) {
+    pairs->clear();
+    uint32_t n = balls->size();
+
+    auto min_x = [balls](uint32_t i) {
+        return balls->x[i] - balls->radius[i];
+    };
+
+    if(order.size() != n) {
+        order.resize(n);
+        iota(order.begin(), order.end(), 0);
+        sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return min_x(a) < min_x(b); });
+    }
+    else {
+        // Balls barely move between steps, so insertion sort is close to linear
+        for(uint32_t k = 1; k < n; k++) {
+            uint32_t ball = order[k];
+            float key = min_x(ball);
+            uint32_t m = k;
+            while(m > 0 && min_x(order[m - 1]) > key) {
+                order[m] = order[m - 1];
+                m--;
+            }
+            order[m] = ball;
+        }
+    }
+
+    for(uint32_t a = 0; a < n; a++) {
+        uint32_t ia = order[a];
+        float max_x = balls->x[ia] + balls->radius[ia];
+        for(uint32_t b = a + 1; b < n && min_x(order[b]) <= max_x; b++) {
+            uint32_t ib = order[b];
+            if(boxes_overlap(balls, ia, ib)) {
+                pairs->push_back({max(ia, ib), min(ia, ib)});
+            }
+        }
+    }
+    sort(pairs->begin(), pairs->end(), pair_order);
+}
+
+unique_ptr<BroadPhase> SweepAndPrune::clone() const {
+    return make_unique<SweepAndPrune>(*this);
+}
+
+// Factory
+
+unique_ptr<BroadPhase> make_broad_phase(broad_phase_type type) {
+    switch(type) {
+        case UNIFORM_GRID: {
+            return make_unique<UniformGrid>();
+        }
+        case SWEEP_AND_PRUNE: {
+            return make_unique<SweepAndPrune>();
+        }
+        default: {
+            return make_unique<BruteForce>();
+        }
+    }
+}
+
+broad_phase_type choose_broad_phase(size_t ball_count) {
+    if(ball_count < 16) return BRUTE_FORCE;
+    if(ball_count < 2048) return SWEEP_AND_PRUNE;
+    return UNIFORM_GRID;
+}
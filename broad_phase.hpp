@@ -0,0 +1,76 @@
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include "ball_store.hpp"
+
+#pragma once
+
+using namespace std;
+
+// Candidate pair for the narrow phase, always with i > j. Pairs come out
+// sorted by i then j, the same order the brute-force double loop visits
+// them in, so swapping broad phases does not change the resolution order.
+
+struct BallPair {
+    uint32_t i, j;
+};
+
+enum broad_phase_type {
+    BRUTE_FORCE,
+    UNIFORM_GRID,
+    SWEEP_AND_PRUNE
+};
+
+class BroadPhase {
+    public:
+    virtual ~BroadPhase() {}
+
+    // Every pair whose bounding boxes overlap, possibly more
+    virtual void find_pairs(const BallStore *balls, vector<BallPair> *pairs) = 0;
+    virtual unique_ptr<BroadPhase> clone() const = 0;
+    virtual broad_phase_type type() const = 0;
+};
+
+// All n(n-1)/2 pairs, cheapest for a standard 16 ball rack
+class BruteForce : public BroadPhase {
+    public:
+    void find_pairs(const BallStore *balls, vector<BallPair> *pairs) override;
+    unique_ptr<BroadPhase> clone() const override;
+    broad_phase_type type() const override {
+        return BRUTE_FORCE;
+    }
+};
+
+// Spatial hash of cells two radii wide, each ball checks its 3x3 block
+class UniformGrid : public BroadPhase {
+    private:
+    vector<int32_t>  cell_x, cell_y;
+    vector<uint32_t> bucket_of;
+    vector<uint32_t> bucket_start;
+    vector<uint32_t> sorted;
+
+    public:
+    void find_pairs(const BallStore *balls, vector<BallPair> *pairs) override;
+    unique_ptr<BroadPhase> clone() const override;
+    broad_phase_type type() const override {
+        return UNIFORM_GRID;
+    }
+};
+
+// Sorted along x, kept from the last call so re-sorting is near linear
+class SweepAndPrune : public BroadPhase {
+    private:
+    vector<uint32_t> order;
+
+    public:
+    void find_pairs(const BallStore *balls, vector<BallPair> *pairs) override;
+    unique_ptr<BroadPhase> clone() const override;
+    broad_phase_type type() const override {
+        return SWEEP_AND_PRUNE;
+    }
+};
+
+unique_ptr<BroadPhase> make_broad_phase(broad_phase_type type);
+
+// Pick the cheapest broad phase for a ball count, see bench_broadphase
+broad_phase_type choose_broad_phase(size_t ball_count);
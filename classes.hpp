@@ -2,10 +2,12 @@
 #include <vector>
 #include <cmath>
 #include <variant>
+#include "physics.hpp"
+#include "profiler.hpp"
+#include "shot_preview.hpp"
 
 #pragma once
 
-#define PI 3.14159265359
 #define WHITE sf::Color(237, 237, 223, 255)
 
 enum collision_type {
@@ -16,83 +18,11 @@ enum collision_type {
 
 using namespace std;
 
-// Vector and functions
-
-template<class T>
-struct Vector2 {
-    T x, y;
-
-    // Vector-Scalar
-    inline Vector2 operator+(T val) {
-        return {x + val, y + val};
-    }
-
-    inline Vector2 operator-(T val) {
-        return {x - val, y - val};
-    }
-
-    inline Vector2 operator*(T val) {
-        return {x*val, y*val};
-    }
-
-    inline Vector2 operator/(T val) {
-        return {x/val, y/val};
-    }
-
-    // Vector-Vector
-    inline Vector2 operator+(Vector2 other) {
-        return {x + other.x, y + other.y};
-    }
-
-    inline Vector2 operator-(Vector2 other) {
-        return {x - other.x, y - other.y};
-    }
-
-    inline Vector2 operator*(Vector2 other) {
-        return {x*other.x, y*other.y};
-    }
-
-    inline Vector2 operator/(Vector2 other) {
-        return {x/other.x, y/other.y};
-    }
-
-    // Equals
-
-    inline bool operator==(Vector2 other) {
-        return x == other.x && y == other.y;
-    }
-};
-
-float distance(Vector2<float> a, Vector2<float> b) {
-    return sqrt(pow((b.x - a.x), 2) + pow((b.y - a.y), 2));
-}
-
-float magnitude(Vector2<float> vect) {
-    return sqrt(pow(vect.x, 2) + pow(vect.y, 2));
-}
-
-Vector2<float> unit(Vector2<float> vect){
-    if(vect.x == 0 && vect.y == 0) {
-        return {0, 0};
-    }
-    return vect/magnitude(vect);
-}
-
-float angle(Vector2<float> a, Vector2<float> b) {
-    return atan2(a.y - b.y, a.x - b.x);
-}
-
-float dot(Vector2<float> a, Vector2<float> b) {
-    return a.x*b.x + a.y*b.y;
-}
-
-Vector2<float> reflect(Vector2<float> vect, Vector2<float> norm) {
-    return (vect - norm*2*dot(norm, vect));
-}
-
 // Classes
 
-class Ball {
+// Rendering for a physics Ball, which only holds plain data
+
+class BallSprite {
     private:
     sf::CircleShape back;
     sf::ConvexShape stripe;
@@ -101,25 +31,17 @@ class Ball {
     sf::CircleShape outline;
 
     public:
-    Vector2<float>    position, velocity;
-    float             radius, mass;
-    float             friction;
+    float             radius;
     bool              is_striped;
     sf::Color         color;
     int               number;
-    bool              is_moving;
 
     //Constructors
-    Ball(float x, float y, float r, float m, float f, bool striped, sf::Color col, int num, sf::Font *font) {
-        position = Vector2<float>{x, y};
-        velocity = Vector2<float>{0, 0};
+    BallSprite(float r, bool striped, sf::Color col, int num, sf::Font *font) {
         radius = r;
-        mass = m;
-        friction = f;
         is_striped = striped;
         color = col;
         number = num;
-        is_moving = false;
 
         back.setRadius(radius);
         back.setOrigin(radius, radius);
@@ -166,25 +88,7 @@ class Ball {
         outline.setOutlineColor(sf::Color::Black);
     }
 
-    // Methods
-    bool moving() {
-        return magnitude(velocity) >= 10.f;
-    }
-
-    void update(float dt) {        
-        Vector2<float> acceleration = velocity*friction*-1;
-        position = position + velocity*dt + acceleration*dt*dt/2.f;
-        velocity = velocity + acceleration*dt;
-
-        if(is_moving) {
-            if(!moving()) {
-                velocity = Vector2<float>{0.f, 0.f};
-                is_moving = false;
-            }
-        }
-    }
-
-    void draw(sf::RenderWindow *window) {
+    void draw(sf::RenderTarget *window, Vector2<float> position) {
         back.setPosition(position.x, position.y);
         window->draw(back);
 
@@ -206,6 +110,121 @@ class Ball {
     }
 };
 
+// Every BallSprite baked once into a texture atlas, then all balls drawn
+// as textured quads in a single draw call per frame. The atlas can also
+// come ready made from the asset cache, skipping the sprites entirely.
+
+class BallBatch {
+    private:
+    sf::Texture atlas;
+    size_t      sprites;
+    // Atlas pixels per world unit, enough for the closest zoom
+    float bake_scale;
+    // Side of one atlas cell in world units
+    float cell;
+    int   columns;
+    sf::VertexArray  quads;
+    sf::VertexBuffer buffer;
+
+    public:
+    BallBatch(vector<BallSprite> &sprite_list, float scale = 2.f) : quads(sf::Quads), buffer(sf::Quads, sf::VertexBuffer::Stream) {
+        sprites = sprite_list.size();
+        bake_scale = scale;
+        float largest = 0.f;
+        for(auto &sprite : sprite_list) {
+            largest = max(largest, sprite.radius);
+        }
+        // Room for the outline drawn just past the radius, whole units so
+        // the number labels BallSprite snaps to integers stay centred
+        cell = 2*ceilf(largest + 2);
+        columns = max(1, (int)ceilf(sqrtf((float)sprites)));
+        int rows = ((int)sprites + columns - 1)/columns;
+
+        sf::ContextSettings settings;
+        settings.antialiasingLevel = 8;
+        sf::RenderTexture target;
+        target.create(ceilf(columns*cell*bake_scale), ceilf(rows*cell*bake_scale), settings);
+
+        sf::View view;
+        view.setSize(columns*cell, rows*cell);
+        view.setCenter(columns*cell/2, rows*cell/2);
+        target.setView(view);
+        target.clear(sf::Color::Transparent);
+        for(size_t s = 0; s < sprites; s++) {
+            sprite_list[s].draw(&target, cell_center(s));
+        }
+        target.display();
+        atlas = target.getTexture();
+        atlas.setSmooth(true);
+    }
+
+    // An atlas baked before, width x height RGBA8 pixels
+    BallBatch(const uint8_t *pixels, unsigned width, unsigned height, size_t sprite_count, int atlas_columns,
+              float atlas_cell, float scale) : quads(sf::Quads), buffer(sf::Quads, sf::VertexBuffer::Stream) {
+        sprites = sprite_count;
+        bake_scale = scale;
+        cell = atlas_cell;
+        columns = atlas_columns;
+        atlas.create(width, height);
+        atlas.update(pixels);
+        atlas.setSmooth(true);
+    }
+
+    BallBatch(const BallBatch &) = delete;
+    BallBatch &operator=(const BallBatch &) = delete;
+
+    Vector2<float> cell_center(size_t sprite) const {
+        return {(sprite % columns + .5f)*cell, (sprite / columns + .5f)*cell};
+    }
+
+    // What the asset cache needs to rebuild this batch
+    sf::Image atlas_image() const {
+        return atlas.copyToImage();
+    }
+    size_t size() const {
+        return sprites;
+    }
+    int atlas_columns() const {
+        return columns;
+    }
+    float atlas_cell() const {
+        return cell;
+    }
+    float atlas_scale() const {
+        return bake_scale;
+    }
+
+    void clear() {
+        quads.clear();
+    }
+
+    void add(size_t sprite, Vector2<float> position) {
+        Vector2<float> texture_center = cell_center(sprite)*bake_scale;
+        float half = cell/2, texture_half = cell*bake_scale/2;
+        const float corners[4][2] = {{-1, -1}, {1, -1}, {1, 1}, {-1, 1}};
+        for(auto &corner : corners) {
+            quads.append(sf::Vertex(
+                sf::Vector2f(position.x + corner[0]*half, position.y + corner[1]*half),
+                sf::Vector2f(texture_center.x + corner[0]*texture_half, texture_center.y + corner[1]*texture_half)));
+        }
+    }
+
+    void draw(sf::RenderTarget *window) {
+        size_t count = quads.getVertexCount();
+        if(count == 0) return;
+
+        sf::RenderStates states(&atlas);
+        if(sf::VertexBuffer::isAvailable()) {
+            if(buffer.getVertexCount() < count) buffer.create(count*2);
+            buffer.update(&quads[0], count, 0);
+            window->draw(buffer, 0, count, states);
+        }
+        else {
+            window->draw(quads, states);
+        }
+    }
+};
+
 class Cue {
     public:
 
@@ -217,23 +236,122 @@ class Cue {
         length = l;
     }
 
-    void draw(sf::RenderWindow *window) {
+    void draw(sf::RenderTarget *window) {
         
     }
 };
 
+// Debug drawing for a cushion Line
+
+class LineSprite {
+    private:
+    sf::RectangleShape line;
+
+    public:
+    LineSprite(const Line &cushion) {
+        Vector2<float> p1 = cushion.p1;
+        Vector2<float> p2 = cushion.p2;
+
+        line.setSize(sf::Vector2f(distance(p1, p2), 8));
+        line.setOrigin(0, 4);
+        line.setPosition(p1.x, p1.y);
+        line.setRotation(angle(p1, p2)*180.f/PI+180);
+        line.setFillColor(sf::Color(255, 0, 0, 75));
+    }
+
+    void draw(sf::RenderTarget *window) {
+        window->draw(line);
+    }
+
+    sf::FloatRect bounds() const {
+        return line.getGlobalBounds();
+    }
+};
+
+// The table never changes during a game, so the sprite, pockets and
+// debug lines are composited once into an off-screen layer and each
+// frame draws that as one textured quad. The layer is baked again only
+// when the zoom drifts far enough from the resolution it was baked at.
+
 class Table {
     private:
     sf::Texture texture;
     sf::Sprite sprite;
 
+    sf::RenderTexture layer;
+    sf::Sprite        layer_sprite;
+    // Layer pixels per world unit, 0 until the first bake
+    float             baked_scale;
+    bool              baked_lines;
+
+    sf::FloatRect bounds() const {
+        sf::FloatRect area = sprite.getGlobalBounds();
+        float left = area.left, top = area.top;
+        float right = area.left + area.width, bottom = area.top + area.height;
+        auto grow = [&](sf::FloatRect r) {
+            left = min(left, r.left);
+            top = min(top, r.top);
+            right = max(right, r.left + r.width);
+            bottom = max(bottom, r.top + r.height);
+        };
+        for(auto &hole : holes) {
+            grow(hole.getGlobalBounds());
+        }
+        if(show_lines) {
+            for(auto &line : lines) {
+                grow(line.bounds());
+            }
+        }
+        return sf::FloatRect(left, top, right - left, bottom - top);
+    }
+
+    void bake(float scale) {
+        sf::FloatRect area = bounds();
+
+        sf::ContextSettings settings;
+        settings.antialiasingLevel = 8;
+        layer.create(ceilf(area.width*scale), ceilf(area.height*scale), settings);
+        layer.setSmooth(true);
+
+        sf::View view;
+        view.setCenter(area.left + area.width/2, area.top + area.height/2);
+        view.setSize(area.width, area.height);
+        layer.setView(view);
+
+        layer.clear(sf::Color::Transparent);
+        layer.draw(sprite);
+        for(auto &hole : holes) {
+            layer.draw(hole);
+        }
+        if(show_lines) {
+            for(auto &line : lines) {
+                line.draw(&layer);
+            }
+        }
+        layer.display();
+
+        layer_sprite.setTexture(layer.getTexture(), true);
+        layer_sprite.setPosition(area.left, area.top);
+        layer_sprite.setScale(1.f/scale, 1.f/scale);
+        baked_scale = scale;
+        baked_lines = show_lines;
+    }
+
     public:
     vector<Vector2<float>> hole_position;
     vector<sf::CircleShape> holes;
     float hole_radius;
 
-    Table(Vector2<float> pos, float scale, Vector2<float> corner_hole, Vector2<float> side_hole, float hole_r, sf::Image *image) {
-        texture.loadFromImage(*image);
+    vector<LineSprite> lines;
+    bool               show_lines;
+    // How far the zoom may drift from the baked resolution, as a factor
+    float              rebake_ratio;
+
+    // The table image as width x height RGBA8 pixels, decoded or from the asset cache
+    Table(Vector2<float> pos, float scale, const vector<Vector2<float>> &pockets, float hole_r,
+          const uint8_t *pixels, unsigned width, unsigned height) {
+        texture.create(width, height);
+        texture.update(pixels);
         texture.setSmooth(true);
 
         sprite.setTexture(texture);
@@ -243,14 +361,7 @@ class Table {
         // sprite.setRotation(90);
 
         hole_radius = hole_r;
-
-        hole_position.push_back(corner_hole);
-        hole_position.push_back(corner_hole*Vector2<float>{-1.f, 1.f});
-        hole_position.push_back(corner_hole*Vector2<float>{1.f, -1.f});
-        hole_position.push_back(corner_hole*Vector2<float>{-1.f, -1.f});
-
-        hole_position.push_back(side_hole);
-        hole_position.push_back(side_hole*Vector2<float>{-1.f, 1.f});
+        hole_position = pockets;
 
         for(auto pos : hole_position) {
             sf::CircleShape hole;
@@ -260,51 +371,152 @@ class Table {
             hole.setFillColor(sf::Color::Black);
             holes.push_back(hole);
         }
+
+        show_lines = false;
+        rebake_ratio = 1.5f;
+        baked_scale = 0.f;
+        baked_lines = false;
     }
 
-    void draw(sf::RenderWindow *window) {
-        window->draw(sprite);
+    void set_lines(const vector<Line> &cushions) {
+        lines.clear();
+        for(auto &line : cushions) {
+            lines.push_back(LineSprite(line));
+        }
+        baked_scale = 0.f;
+    }
 
-        for(auto hole : holes) {
-            window->draw(hole);
+    void draw(sf::RenderTarget *window) {
+        // Screen pixels per world unit under the current view, capped so
+        // the layer fits in a texture
+        sf::FloatRect area = bounds();
+        float max_side = sf::Texture::getMaximumSize();
+        float wanted = window->getSize().x/fabsf(window->getView().getSize().x);
+        wanted = min(wanted, min(max_side/area.width, max_side/area.height));
+
+        if(baked_scale == 0.f || baked_lines != show_lines ||
+           wanted > baked_scale*rebake_ratio || wanted < baked_scale/rebake_ratio) {
+            bake(wanted);
         }
+        window->draw(layer_sprite);
     }
 };
 
-class Line {
+// The shot being aimed as ShotPreview predicts it: the cue ball path, a
+// ghost ball where it first meets another ball with a line the way that
+// ball goes, and a dot at every cushion bounce. Toggled with F5.
+
+class ShotPreviewOverlay {
     private:
-    sf::RectangleShape line;
+    sf::VertexArray path;
+    sf::VertexArray heading;
+    sf::CircleShape ghost;
+    sf::CircleShape bounce;
+    float           radius;
 
     public:
-    Vector2<float> p1, p2, normal;
-    float length;
+    bool visible;
+
+    ShotPreviewOverlay(float ball_radius) : path(sf::LineStrip), heading(sf::Lines, 2) {
+        visible = true;
+        radius = ball_radius;
+
+        ghost.setRadius(radius - 1);
+        ghost.setOrigin(radius - 1, radius - 1);
+        ghost.setPointCount(60);
+        ghost.setFillColor(sf::Color(255, 255, 255, 40));
+        ghost.setOutlineThickness(1.5f);
+        ghost.setOutlineColor(sf::Color(255, 255, 255, 200));
+
+        bounce.setRadius(3);
+        bounce.setOrigin(3, 3);
+        bounce.setFillColor(sf::Color(255, 255, 255, 200));
+    }
 
-    Line(Vector2<float> point1, Vector2<float> point2) {
-        p1 = point1;
-        p2 = point2;
-        normal = unit(Vector2<float>{-(p2.y - p1.y), p2.x - p1.x});
-        length = distance(p1, p2);
+    void draw(sf::RenderTarget *window, const ShotPrediction &prediction) {
+        if(!visible || prediction.path.empty()) return;
 
-        line.setSize(sf::Vector2f(distance(p1, p2), 8));
-        line.setOrigin(0, 4);
-        line.setPosition(p1.x, p1.y);
-        line.setRotation(angle(p1, p2)*180.f/PI+180);
-        line.setFillColor(sf::Color(255, 0, 0, 75));
+        // Fainter while the path is still being worked out
+        sf::Color color(255, 255, 255, prediction.complete ? 200 : 110);
+        path.clear();
+        for(auto &point : prediction.path) {
+            path.append(sf::Vertex(sf::Vector2f(point.x, point.y), color));
+        }
+        window->draw(path);
+
+        for(auto &point : prediction.bounces) {
+            bounce.setPosition(point.x, point.y);
+            window->draw(bounce);
+        }
+
+        if(prediction.first_contact >= 0) {
+            Vector2<float> contact = prediction.contact_position;
+            ghost.setPosition(contact.x, contact.y);
+            window->draw(ghost);
+
+            // From the object ball's centre, which touches the ghost along its heading
+            Vector2<float> from = contact + prediction.object_direction*(2*radius);
+            Vector2<float> to = from + prediction.object_direction*(4*radius);
+            heading[0] = sf::Vertex(sf::Vector2f(from.x, from.y), color);
+            heading[1] = sf::Vertex(sf::Vector2f(to.x, to.y), color);
+            window->draw(heading);
+        }
     }
-    
-    // https://www.youtube.com/watch?v=h1WXaa2UwLQ
-    bool collision(Vector2<float> pos, float radius) {
-        float dot_product = dot(pos - p1, p2 - p1) / (length*length);
-        Vector2<float> closest = p1 + (p2-p1)*dot_product;
-
-        if(distance(pos, p1) <= radius || distance(pos, p2) <= radius) return true;
-        if(distance(closest, p1) + distance(closest, p2) - 1 > length) return false;
-        if(distance(pos, closest) <= radius) return true;
-        return false;
+};
+
+// Profiler summary in the window's top left corner, toggled with F3
+
+class ProfilerOverlay {
+    private:
+    sf::Text text;
+    sf::RectangleShape background;
+
+    public:
+    bool   visible;
+    // Frames averaged for the phase times
+    size_t window_frames;
+
+    ProfilerOverlay(sf::Font *font) {
+        visible = false;
+        window_frames = 60;
+
+        text.setFont(*font);
+        text.setCharacterSize(14);
+        text.setFillColor(sf::Color::White);
+        text.setPosition(10, 10);
+        background.setFillColor(sf::Color(0, 0, 0, 170));
+        background.setPosition(4, 4);
     }
 
-    void draw(sf::RenderWindow *window) {
-        window->draw(line);
+    void draw(sf::RenderTarget *window, const Profiler &profiler) {
+        if(!visible) return;
+
+        char line[128];
+        string summary;
+        size_t frames = min(window_frames, profiler.frames.size());
+        double worst = 0;
+        for(size_t f = profiler.frames.size() - frames; f < profiler.frames.size(); f++) {
+            worst = max(worst, profiler.frames[f].duration_ns/1e6);
+        }
+        snprintf(line, sizeof(line), "frame %.2f ms (worst %.2f) over %zu frames\n", profiler.average_frame_ms(frames), worst, frames);
+        summary += line;
+        for(auto &total : profiler.totals(frames)) {
+            snprintf(line, sizeof(line), "%-28s %7.3f ms  x%.0f\n", total.name, total.ms_per_frame, total.calls_per_frame);
+            summary += line;
+        }
+        for(int c = 0; c < COUNTER_COUNT; c++) {
+            snprintf(line, sizeof(line), "%-28s %7.1f / frame\n", profile_counter_names[c], profiler.average_counter((profile_counter)c, frames));
+            summary += line;
+        }
+        text.setString(summary);
+
+        // Drawn in pixels, whatever the table view is zoomed to
+        sf::View table_view = window->getView();
+        window->setView(window->getDefaultView());
+        sf::FloatRect bounds = text.getLocalBounds();
+        background.setSize(sf::Vector2f(bounds.width + 14, bounds.height + 16));
+        window->draw(background);
+        window->draw(text);
+        window->setView(table_view);
     }
 };
-
@@ -0,0 +1,133 @@
+#include <algorithm>
+#include "contact_solver.hpp"
+#include "thread_pool.hpp"
+
+using namespace std;
+
+// Contacts where both balls are on the table and overlap
+void ContactSolver::gather(const BallStore *balls, const vector<BallPair> &pairs) {
+    found.clear();
+    for(auto &pair : pairs) {
+        uint32_t i = pair.i, j = pair.j;
+        if(balls->is_pocketed(i) || balls->is_pocketed(j)) continue;
+
+        Vector2<float> gap = balls->position(i) - balls->position(j);
+        float reach = balls->radius[i] + balls->radius[j];
+        float gap_squared = magnitude_squared(gap);
+        if(gap_squared > reach*reach) continue;
+
+        float gap_length = scalar_sqrt(gap_squared);
+        Contact contact;
+        contact.i = i;
+        contact.j = j;
+        contact.normal = gap_length == 0.f ? Vector2<float>{0.f, 0.f} : gap/gap_length;
+        contact.inverse_mass_i = 1.f/balls->mass[i];
+        contact.inverse_mass_j = 1.f/balls->mass[j];
+        contact.effective_mass = 1.f/(contact.inverse_mass_i + contact.inverse_mass_j);
+        float approach = dot(balls->velocity(i) - balls->velocity(j), contact.normal);
+        contact.target = approach < 0.f ? -restitution*approach : 0.f;
+        contact.impulse = 0.f;
+        found.push_back(contact);
+    }
+}
+
+// Greedy colouring in pair order, the lowest colour neither ball has yet.
+// Past 64 colours everything shares the last one, which is then run in
+// order on one thread.
+void ContactSolver::color(size_t ball_count) {
+    if(ball_colors.size() < ball_count) ball_colors.resize(ball_count, 0);
+
+    contact_color.resize(found.size());
+    uint32_t color_count = 0;
+    for(size_t k = 0; k < found.size(); k++) {
+        uint64_t used = ball_colors[found[k].i] | ball_colors[found[k].j];
+        uint32_t c = ~used == 0 ? overflow_color : __builtin_ctzll(~used);
+        if(c < overflow_color) {
+            ball_colors[found[k].i] |= 1ull << c;
+            ball_colors[found[k].j] |= 1ull << c;
+        }
+        contact_color[k] = c;
+        color_count = max(color_count, c + 1);
+    }
+    for(auto &contact : found) {
+        ball_colors[contact.i] = 0;
+        ball_colors[contact.j] = 0;
+    }
+
+    // Counting sort by colour, keeping pair order inside each
+    color_start.assign(color_count + 1, 0);
+    for(uint32_t c : contact_color) {
+        color_start[c + 1]++;
+    }
+    for(uint32_t c = 0; c < color_count; c++) {
+        color_start[c + 1] += color_start[c];
+    }
+    slot.assign(color_start.begin(), color_start.end() - 1);
+    order.resize(found.size());
+    for(uint32_t k = 0; k < found.size(); k++) {
+        order[slot[contact_color[k]]++] = k;
+    }
+}
+
+template<class F>
+void ContactSolver::for_each_contact(ThreadPool *pool, F relax) {
+    for(size_t c = 0; c + 1 < color_start.size(); c++) {
+        uint32_t start = color_start[c], end = color_start[c + 1];
+        bool shared = c == overflow_color;
+        if(!pool || shared || end - start < parallel_threshold) {
+            for(uint32_t k = start; k < end; k++) {
+                relax(found[order[k]]);
+            }
+            continue;
+        }
+
+        pool_batches++;
+        size_t chunks = pool->size();
+        for(size_t t = 0; t < chunks; t++) {
+            uint32_t from = start + (end - start)*t/chunks, to = start + (end - start)*(t + 1)/chunks;
+            pool->submit([this, &relax, from, to] {
+                for(uint32_t k = from; k < to; k++) {
+                    relax(found[order[k]]);
+                }
+            });
+        }
+        pool->wait_idle();
+    }
+}
+
+size_t ContactSolver::solve(BallStore *balls, const vector<BallPair> &pairs, ThreadPool *pool) {
+    gather(balls, pairs);
+    if(found.empty()) return 0;
+    color(balls->size());
+
+    // Velocities: push each contact's normal speed towards its target
+    for(int iteration = 0; iteration < velocity_iterations; iteration++) {
+        for_each_contact(pool, [balls](Contact &contact) {
+            Vector2<float> relative = balls->velocity(contact.i) - balls->velocity(contact.j);
+            float change = (contact.target - dot(relative, contact.normal))*contact.effective_mass;
+            float total = max(contact.impulse + change, 0.f);
+            change = total - contact.impulse;
+            contact.impulse = total;
+
+            Vector2<float> push = contact.normal*change;
+            balls->set_velocity(contact.i, balls->velocity(contact.i) + push*contact.inverse_mass_i);
+            balls->set_velocity(contact.j, balls->velocity(contact.j) - push*contact.inverse_mass_j);
+        });
+    }
+
+    // Positions: take out what overlap is left, the lighter ball moving further
+    for(int iteration = 0; iteration < position_iterations; iteration++) {
+        for_each_contact(pool, [balls](Contact &contact) {
+            Vector2<float> gap = balls->position(contact.i) - balls->position(contact.j);
+            float reach = balls->radius[contact.i] + balls->radius[contact.j];
+            float gap_squared = magnitude_squared(gap);
+            if(gap_squared >= reach*reach || gap_squared == 0.f) return;
+
+            float gap_length = scalar_sqrt(gap_squared);
+            Vector2<float> correction = gap*((reach - gap_length)/gap_length*contact.effective_mass);
+            balls->set_position(contact.i, balls->position(contact.i) + correction*contact.inverse_mass_i);
+            balls->set_position(contact.j, balls->position(contact.j) - correction*contact.inverse_mass_j);
+        });
+    }
+    return found.size();
+}
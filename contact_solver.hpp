@@ -0,0 +1,82 @@
+#include <vector>
+#include <cstdint>
+#include "ball_store.hpp"
+#include "broad_phase.hpp"
+#include "vector_functions.hpp"
+
+#pragma once
+
+using namespace std;
+
+class ThreadPool;
+
+// Past this many colours every further contact shares the last one
+const uint32_t overflow_color = 64;
+
+// Two touching balls, normal pointing from j to i
+struct Contact {
+    uint32_t       i, j;
+    Vector2<float> normal;
+    float          inverse_mass_i, inverse_mass_j;
+    float          effective_mass;
+    // Normal speed apart the impulses aim for, restitution times the
+    // approach speed when the contact was found
+    float          target;
+    // Total impulse so far, never negative, so balls are only pushed apart
+    float          impulse;
+};
+
+// Resolves every contact of a sub-step together instead of one pair at a
+// time in loop order. Contacts are greedily coloured so no two of one
+// colour share a ball (the overflow colour excepted, which runs on one
+// thread), then each colour is relaxed as a batch for a few
+// impulse iterations, and overlap is removed the same way, split by
+// inverse mass rather than pushing both balls by the full overlap.
+//
+// Inside a colour nothing is shared, so a large colour is split over the
+// pool and the result does not depend on the thread count. The pool
+// should be one nothing else is waiting on.
+
+class ContactSolver {
+    private:
+    vector<Contact>  found;
+    // Contact indices grouped by colour, colour c at [color_start[c], color_start[c+1])
+    vector<uint32_t> order;
+    vector<uint32_t> color_start;
+    // Colours already used around each ball, bit c for colour c
+    vector<uint64_t> ball_colors;
+    vector<uint32_t> contact_color;
+    vector<uint32_t> slot;
+
+    void gather(const BallStore *balls, const vector<BallPair> &pairs);
+    void color(size_t ball_count);
+    template<class F>
+    void for_each_contact(ThreadPool *pool, F relax);
+
+    public:
+    int   velocity_iterations;
+    int   position_iterations;
+    float restitution;
+    // Smallest colour worth handing to the pool
+    size_t parallel_threshold;
+    // Colours handed to the pool over every solve so far
+    long   pool_batches;
+
+    ContactSolver() {
+        velocity_iterations = 4;
+        position_iterations = 2;
+        restitution = 1.f;
+        parallel_threshold = 512;
+        pool_batches = 0;
+    }
+
+    // Returns the number of contacts, pool may be null
+    size_t solve(BallStore *balls, const vector<BallPair> &pairs, ThreadPool *pool);
+
+    const vector<Contact> &contacts() const {
+        return found;
+    }
+    size_t colors() const {
+        return color_start.empty() ? 0 : color_start.size() - 1;
+    }
+};
@@ -0,0 +1,68 @@
+#include <algorithm>
+#include "cushion_grid.hpp"
+#include "physics.hpp"
+
+using namespace std;
+
+void CushionGrid::build(const vector<Line> &lines, float radius) {
+    segments.clear();
+    cell_start.clear();
+    cell_lines.clear();
+    built_radius = radius;
+    columns = 0;
+    rows = 0;
+    if(lines.empty() || radius <= 0) return;
+
+    Vector2<float> low = lines[0].p1, high = lines[0].p1;
+    for(auto &line : lines) {
+        Segment segment;
+        segment.p1 = line.p1;
+        segment.direction = line.p2 - line.p1;
+        segment.inverse_length_squared = 1.f/dot(segment.direction, segment.direction);
+        segments.push_back(segment);
+
+        low = {min({low.x, line.p1.x, line.p2.x}), min({low.y, line.p1.y, line.p2.y})};
+        high = {max({high.x, line.p1.x, line.p2.x}), max({high.y, line.p1.y, line.p2.y})};
+    }
+
+    // A ball further than radius from every cushion can never touch one
+    float cell_size = 2*radius;
+    origin = low - radius;
+    inverse_cell_size = 1.f/cell_size;
+    columns = (int)((high.x - low.x + 2*radius)*inverse_cell_size) + 1;
+    rows = (int)((high.y - low.y + 2*radius)*inverse_cell_size) + 1;
+
+    vector<vector<uint32_t>> cells(columns*rows);
+    for(uint32_t l = 0; l < segments.size(); l++) {
+        const Segment &segment = segments[l];
+        Vector2<float> p2 = segment.p1 + segment.direction;
+        Vector2<float> box_low = Vector2<float>{min(segment.p1.x, p2.x), min(segment.p1.y, p2.y)} - radius;
+        Vector2<float> box_high = Vector2<float>{max(segment.p1.x, p2.x), max(segment.p1.y, p2.y)} + radius;
+
+        int x0 = max(0, (int)((box_low.x - origin.x)*inverse_cell_size));
+        int y0 = max(0, (int)((box_low.y - origin.y)*inverse_cell_size));
+        int x1 = min(columns - 1, (int)((box_high.x - origin.x)*inverse_cell_size));
+        int y1 = min(rows - 1, (int)((box_high.y - origin.y)*inverse_cell_size));
+
+        for(int y = y0; y <= y1; y++) {
+            for(int x = x0; x <= x1; x++) {
+                // Keep the cell only if the cushion really comes within radius of it
+                Vector2<float> cell_low = origin + Vector2<float>{(float)x, (float)y}*cell_size;
+                Vector2<float> centre = cell_low + cell_size/2;
+                Vector2<float> offset = centre - segment.p1;
+                float t = max(0.f, min(1.f, dot(offset, segment.direction)*segment.inverse_length_squared));
+                Vector2<float> gap = offset - segment.direction*t;
+                float reach = radius + cell_size*0.70711f;
+                if(dot(gap, gap) > reach*reach) continue;
+
+                cells[y*columns + x].push_back(l);
+            }
+        }
+    }
+
+    cell_start.push_back(0);
+    for(auto &cell : cells) {
+        cell_lines.insert(cell_lines.end(), cell.begin(), cell.end());
+        cell_start.push_back(cell_lines.size());
+    }
+}
@@ -0,0 +1,58 @@
+#include <vector>
+#include <cstdint>
+#include "vector_functions.hpp"
+#include "physics_kernels.hpp"
+
+#pragma once
+
+using namespace std;
+
+class Line;
+
+// Cushion segment with everything the ball test needs precomputed
+struct Segment {
+    Vector2<float> p1, direction;
+    float inverse_length_squared;
+};
+
+// Static grid over the cushions, built once from the table lines. Each
+// cell lists the cushions a ball centred in it could touch, so a ball in
+// open table space finds an empty cell and skips cushion tests.
+
+class CushionGrid {
+    private:
+    vector<Segment>  segments;
+    vector<uint32_t> cell_start;
+    vector<uint32_t> cell_lines;
+    Vector2<float>   origin;
+    float            inverse_cell_size;
+    int              columns, rows;
+
+    public:
+    float            built_radius;
+
+    CushionGrid() {
+        origin = {0, 0};
+        inverse_cell_size = 0;
+        columns = 0;
+        rows = 0;
+        built_radius = -1;
+    }
+
+    // Cells are two ball radii wide and hold every cushion within radius
+    void build(const vector<Line> &lines, float radius);
+
+    // Calls hit(line index) for each cushion the ball overlaps, in line order
+    template<class Hit>
+    void query(Vector2<float> pos, float radius, Hit hit) const {
+        int cx = (int)floorf((pos.x - origin.x)*inverse_cell_size);
+        int cy = (int)floorf((pos.y - origin.y)*inverse_cell_size);
+        if(cx < 0 || cy < 0 || cx >= columns || cy >= rows) return;
+
+        int cell = cy*columns + cx;
+        for(uint32_t k = cell_start[cell]; k < cell_start[cell + 1]; k++) {
+            const Segment &segment = segments[cell_lines[k]];
+            if(touches_segment(pos, radius, segment.p1, segment.direction, segment.inverse_length_squared)) hit(cell_lines[k]);
+        }
+    }
+};
@@ -0,0 +1,331 @@
+#include <cmath>
+#include <limits>
+#include "event_engine.hpp"
+#include "profiler.hpp"
+
+using namespace std;
+
+const double never = numeric_limits<double>::infinity();
+
+// Slower approaches are rounding noise from the last contact, treating
+// them as hits makes two touching balls collide forever at one instant
+const double min_approach_speed = 1e-6;
+
+// Motion
+
+// Distance factor covered after t seconds, v0*reach is the displacement
+static double reach_after(double f, double t) {
+    if(f <= 0) return t;
+    return -expm1(-f*t)/f;
+}
+
+// Inverse of reach_after, never if friction stops the ball first
+static double time_to_reach(double f, double g) {
+    if(f <= 0) return g;
+    if(f*g >= 1) return never;
+    return -log1p(-f*g)/f;
+}
+
+double EventEngine::reach(size_t i, double t) const {
+    return reach_after(friction[i], t - reference_time[i]);
+}
+
+Vector2<double> EventEngine::position_at(size_t i, double t) const {
+    if(!moving[i]) return {px[i], py[i]};
+    double g = reach(i, t);
+    return {px[i] + vx[i]*g, py[i] + vy[i]*g};
+}
+
+Vector2<double> EventEngine::velocity_at(size_t i, double t) const {
+    if(!moving[i]) return {0, 0};
+    double decay = exp(-friction[i]*(t - reference_time[i]));
+    return {vx[i]*decay, vy[i]*decay};
+}
+
+double EventEngine::stop_time(size_t i) const {
+    if(!moving[i]) return never;
+    double speed = sqrt(vx[i]*vx[i] + vy[i]*vy[i]);
+    if(speed < moving_threshold) return reference_time[i];
+    if(friction[i] <= 0) return never;
+    return reference_time[i] + log(speed/moving_threshold)/friction[i];
+}
+
+void EventEngine::move_to(size_t i, double t) {
+    Vector2<double> p = position_at(i, t);
+    Vector2<double> v = velocity_at(i, t);
+    px[i] = p.x; py[i] = p.y;
+    vx[i] = v.x; vy[i] = v.y;
+    reference_time[i] = t;
+}
+
+// Prediction
+
+void EventEngine::predict_ball(size_t i, size_t j) {
+    if(!moving[i] && !moving[j]) return;
+    if(pocket[i] >= 0 || pocket[j] >= 0) return;
+
+    Vector2<double> pi = position_at(i, time), pj = position_at(j, time);
+    Vector2<double> vi = velocity_at(i, time), vj = velocity_at(j, time);
+
+    // Both balls share one reach curve, so the gap is linear in it
+    Vector2<double> gap = pi - pj;
+    Vector2<double> closing = vi - vj;
+    double r = radius[i] + radius[j];
+
+    double a = closing.x*closing.x + closing.y*closing.y;
+    double b = gap.x*closing.x + gap.y*closing.y;
+    double c = gap.x*gap.x + gap.y*gap.y - r*r;
+    if(a == 0 || b >= -min_approach_speed*sqrt(gap.x*gap.x + gap.y*gap.y)) return;
+
+    double discriminant = b*b - a*c;
+    if(discriminant < 0) return;
+
+    double g = max(0.0, (-b - sqrt(discriminant))/a);
+    double f = moving[i] ? friction[i] : friction[j];
+    double t = time + time_to_reach(f, g);
+
+    // Past a stop the motion changes, the stop event predicts again
+    if(t > min(stop_time(i), stop_time(j))) return;
+    events.push(Event{t, (uint32_t)i, (uint32_t)j, collision_count[i], collision_count[j], BALL_BALL});
+}
+
+void EventEngine::predict_line(size_t i, size_t l) {
+    const Line &line = lines[l];
+    Vector2<double> p = position_at(i, time);
+    Vector2<double> v = velocity_at(i, time);
+    Vector2<double> p1 = {line.p1.x, line.p1.y}, p2 = {line.p2.x, line.p2.y};
+    Vector2<double> normal = {line.normal.x, line.normal.y};
+    Vector2<double> along = (p2 - p1)/(double)line.length;
+    double r = radius[i];
+    double best = never;
+
+    // Flat side of the cushion
+    double height = normal.x*(p.x - p1.x) + normal.y*(p.y - p1.y);
+    double approach = normal.x*v.x + normal.y*v.y;
+    if((height > 0 && approach < -min_approach_speed) || (height < 0 && approach > min_approach_speed)) {
+        double g = max(0.0, ((height > 0 ? r : -r) - height)/approach);
+        Vector2<double> hit = p + v*g - p1;
+        double s = hit.x*along.x + hit.y*along.y;
+        if(s >= 0 && s <= line.length) best = g;
+    }
+
+    // Rounded ends
+    for(Vector2<double> end : {p1, p2}) {
+        Vector2<double> gap = p - end;
+        double a = v.x*v.x + v.y*v.y;
+        double b = gap.x*v.x + gap.y*v.y;
+        double c = gap.x*gap.x + gap.y*gap.y - r*r;
+        double discriminant = b*b - a*c;
+        if(a == 0 || b >= -min_approach_speed*sqrt(gap.x*gap.x + gap.y*gap.y) || discriminant < 0) continue;
+        best = min(best, max(0.0, (-b - sqrt(discriminant))/a));
+    }
+
+    if(best == never) return;
+    double t = time + time_to_reach(friction[i], best);
+    if(t > stop_time(i)) return;
+    events.push(Event{t, (uint32_t)i, (uint32_t)l, collision_count[i], 0, BALL_LINE});
+}
+
+void EventEngine::predict_pocket(size_t i, size_t p) {
+    Vector2<double> gap = position_at(i, time) - Vector2<double>{pockets[p].x, pockets[p].y};
+    Vector2<double> v = velocity_at(i, time);
+
+    // The ball drops once its centre is inside the pocket circle
+    double a = v.x*v.x + v.y*v.y;
+    double b = gap.x*v.x + gap.y*v.y;
+    double c = gap.x*gap.x + gap.y*gap.y - pocket_radius*pocket_radius;
+    double discriminant = b*b - a*c;
+    if(c > 0 && (a == 0 || b >= 0 || discriminant < 0)) return;
+
+    double g = c <= 0 ? 0.0 : (-b - sqrt(discriminant))/a;
+    double t = time + time_to_reach(friction[i], g);
+    if(t > stop_time(i)) return;
+    events.push(Event{t, (uint32_t)i, (uint32_t)p, collision_count[i], 0, BALL_POCKET});
+}
+
+void EventEngine::predict(size_t i) {
+    if(pocket[i] >= 0) return;
+    if(moving[i]) {
+        events.push(Event{stop_time(i), (uint32_t)i, 0, collision_count[i], 0, BALL_STOP});
+        for(size_t l = 0; l < lines.size(); l++) {
+            predict_line(i, l);
+        }
+        for(size_t p = 0; p < pockets.size(); p++) {
+            predict_pocket(i, p);
+        }
+    }
+    for(size_t j = 0; j < px.size(); j++) {
+        if(j != i) predict_ball(i, j);
+    }
+}
+
+// Resolution
+
+void EventEngine::process(const Event &event) {
+    size_t a = event.a, b = event.b;
+    time = event.time;
+
+    switch(event.type) {
+        case BALL_STOP: {
+            move_to(a, time);
+            vx[a] = 0; vy[a] = 0;
+            moving[a] = false;
+            collision_count[a]++;
+            predict(a);
+            break;
+        }
+        case BALL_LINE: {
+            move_to(a, time);
+            const Line &line = lines[b];
+            Vector2<double> p = {px[a], py[a]};
+            Vector2<double> p1 = {line.p1.x, line.p1.y}, p2 = {line.p2.x, line.p2.y};
+            Vector2<double> along = p2 - p1;
+            double s = ((p.x - p1.x)*along.x + (p.y - p1.y)*along.y)/(line.length*line.length);
+
+            // Flat side reflects off the cushion normal, an end off the contact normal
+            Vector2<double> normal = {line.normal.x, line.normal.y};
+            if(s <= 0 || s >= 1) {
+                Vector2<double> gap = p - (s <= 0 ? p1 : p2);
+                normal = gap/sqrt(gap.x*gap.x + gap.y*gap.y);
+            }
+            double d = normal.x*vx[a] + normal.y*vy[a];
+            vx[a] -= 2*d*normal.x;
+            vy[a] -= 2*d*normal.y;
+            collision_count[a]++;
+            predict(a);
+            profile_count(COUNTER_CUSHION_HITS);
+            break;
+        }
+        case BALL_POCKET: {
+            move_to(a, time);
+            px[a] = pockets[b].x; py[a] = pockets[b].y;
+            vx[a] = 0; vy[a] = 0;
+            moving[a] = false;
+            pocket[a] = b;
+            collision_count[a]++;
+            break;
+        }
+        case BALL_BALL: {
+            move_to(a, time);
+            move_to(b, time);
+
+            Vector2<double> gap = {px[a] - px[b], py[a] - py[b]};
+            Vector2<double> normal = gap/sqrt(gap.x*gap.x + gap.y*gap.y);
+            double dot_a = normal.x*vx[a] + normal.y*vy[a];
+            double dot_b = normal.x*vx[b] + normal.y*vy[b];
+            double total = mass[a] + mass[b];
+
+            // Exchange the normal components, same as PhysicsWorld::resolve_ball_pair()
+            double new_a = (dot_a*(mass[a] - mass[b]) + dot_b*2*mass[b])/total;
+            double new_b = (dot_a*2*mass[a] + dot_b*(mass[b] - mass[a]))/total;
+            vx[a] += (new_a - dot_a)*normal.x; vy[a] += (new_a - dot_a)*normal.y;
+            vx[b] += (new_b - dot_b)*normal.x; vy[b] += (new_b - dot_b)*normal.y;
+
+            moving[a] = true;
+            moving[b] = true;
+            collision_count[a]++;
+            collision_count[b]++;
+            predict(a);
+            predict(b);
+            profile_count(COUNTER_COLLISIONS);
+            break;
+        }
+    }
+    events_processed++;
+}
+
+static bool event_is_valid(const Event &event, const vector<uint32_t> &collision_count) {
+    if(collision_count[event.a] != event.count_a) return false;
+    if(event.type == BALL_BALL && collision_count[event.b] != event.count_b) return false;
+    return true;
+}
+
+// Public
+
+void EventEngine::reset(const PhysicsWorld *world) {
+    const BallStore &balls = world->balls;
+    size_t n = balls.size();
+
+    time = 0;
+    lines = world->lines;
+    pockets = world->pockets;
+    pocket_radius = world->pocket_radius;
+    events = {};
+    reference_time.assign(n, 0);
+    collision_count.assign(n, 0);
+    px.resize(n); py.resize(n);
+    vx.resize(n); vy.resize(n);
+    friction.resize(n); radius.resize(n); mass.resize(n);
+    moving.resize(n);
+    pocket.resize(n);
+
+    for(size_t i = 0; i < n; i++) {
+        px[i] = balls.x[i]; py[i] = balls.y[i];
+        vx[i] = balls.vx[i]; vy[i] = balls.vy[i];
+        friction[i] = balls.friction[i];
+        radius[i] = balls.radius[i];
+        mass[i] = balls.mass[i];
+        pocket[i] = balls.pocket[i];
+        moving[i] = balls.is_moving(i) && pocket[i] < 0 && magnitude(balls.velocity(i)) >= moving_threshold;
+        if(!moving[i]) {
+            vx[i] = 0; vy[i] = 0;
+        }
+    }
+
+    for(size_t i = 0; i < n; i++) {
+        if(moving[i]) {
+            events.push(Event{stop_time(i), (uint32_t)i, 0, 0, 0, BALL_STOP});
+            for(size_t l = 0; l < lines.size(); l++) {
+                predict_line(i, l);
+            }
+            for(size_t p = 0; p < pockets.size(); p++) {
+                predict_pocket(i, p);
+            }
+        }
+        for(size_t j = 0; j < i; j++) {
+            predict_ball(i, j);
+        }
+    }
+}
+
+void EventEngine::write_back(PhysicsWorld *world) const {
+    BallStore &balls = world->balls;
+    for(size_t i = 0; i < px.size(); i++) {
+        Vector2<double> p = position_at(i, time);
+        Vector2<double> v = velocity_at(i, time);
+        balls.x[i] = p.x; balls.y[i] = p.y;
+        balls.vx[i] = v.x; balls.vy[i] = v.y;
+        balls.flags[i] = (moving[i] ? (uint32_t)BALL_MOVING : 0u) | (pocket[i] >= 0 ? (uint32_t)BALL_POCKETED : 0u);
+        balls.pocket[i] = pocket[i];
+    }
+}
+
+void EventEngine::advance(PhysicsWorld *world, float dt) {
+    PROFILE_SCOPE("event_engine_advance");
+    double target = time + dt;
+    long handled = 0;
+
+    while(!events.empty() && events.top().time <= target && handled < max_events_per_advance) {
+        Event event = events.top();
+        events.pop();
+        if(!event_is_valid(event, collision_count)) continue;
+        process(event);
+        handled++;
+    }
+    if(handled < max_events_per_advance) time = target;
+    write_back(world);
+}
+
+long EventEngine::run_to_rest(PhysicsWorld *world, long max_events) {
+    long handled = 0;
+
+    while(!events.empty() && handled < max_events) {
+        Event event = events.top();
+        events.pop();
+        if(!event_is_valid(event, collision_count)) continue;
+        process(event);
+        handled++;
+    }
+    write_back(world);
+    return handled;
+}
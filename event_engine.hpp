@@ -0,0 +1,85 @@
+#include <vector>
+#include <queue>
+#include <cstdint>
+#include "physics.hpp"
+
+#pragma once
+
+using namespace std;
+
+// Event-driven alternative to PhysicsWorld::update(). Between events a
+// ball follows the exact solution of Ball friction decay,
+//
+//   v(t) = v0*e^(-f*t)
+//   p(t) = p0 + v0*(1 - e^(-f*t))/f
+//
+// so the engine predicts the exact time of the next ball-ball,
+// ball-cushion, pocket and stop event and jumps straight to it. Nothing can
+// tunnel, however hard the shot. Ball-ball times are exact when the two
+// balls share a friction value, which every table setup here does.
+
+enum event_type {
+    BALL_BALL,
+    BALL_LINE,
+    BALL_POCKET,
+    BALL_STOP
+};
+
+struct Event {
+    double    time;
+    uint32_t  a, b;
+    uint32_t  count_a, count_b;
+    event_type type;
+
+    bool operator>(const Event &other) const {
+        return time > other.time;
+    }
+};
+
+class EventEngine {
+    private:
+    // Ball state at its own reference time, moved forward lazily
+    vector<double>   reference_time;
+    vector<double>   px, py, vx, vy;
+    vector<double>   friction, radius, mass;
+    vector<bool>     moving;
+    vector<int8_t>   pocket;
+    // Bumped on every event a ball takes part in, stale events are skipped
+    vector<uint32_t> collision_count;
+    vector<Line>     lines;
+    vector<Vector2<float>> pockets;
+    float            pocket_radius;
+    priority_queue<Event, vector<Event>, greater<Event>> events;
+
+    double reach(size_t i, double t) const;
+    Vector2<double> position_at(size_t i, double t) const;
+    Vector2<double> velocity_at(size_t i, double t) const;
+    double stop_time(size_t i) const;
+    void move_to(size_t i, double t);
+
+    void predict(size_t i);
+    void predict_ball(size_t i, size_t j);
+    void predict_line(size_t i, size_t l);
+    void predict_pocket(size_t i, size_t p);
+    void process(const Event &event);
+    void write_back(PhysicsWorld *world) const;
+
+    public:
+    double time;
+    long   events_processed;
+    long   max_events_per_advance;
+
+    EventEngine() {
+        time = 0;
+        events_processed = 0;
+        max_events_per_advance = 100000;
+        pocket_radius = 0;
+    }
+
+    // Take ball state from the world, call again after changing it
+    void reset(const PhysicsWorld *world);
+    // Process every event in the next dt seconds and write the world
+    void advance(PhysicsWorld *world, float dt);
+    // Process events until every ball stops, returns the events handled
+    long run_to_rest(PhysicsWorld *world, long max_events);
+};
@@ -0,0 +1,67 @@
+#include <vector>
+#include <functional>
+#include "physics.hpp"
+
+#pragma once
+
+using namespace std;
+
+const float default_tick_rate = 120.f;
+const int default_max_catch_up = 8;
+
+// Turns variable frame times into whole physics ticks of one fixed dt,
+// so results no longer depend on frame rate and a hitch frame can not
+// hand the physics a huge dt. Leftover time carries to the next frame
+// and drawing interpolates between the last two ticks.
+
+class FixedStepper {
+    private:
+    vector<float> previous_x, previous_y;
+
+    public:
+    float tick_dt;
+    float accumulator;
+    int   max_catch_up;
+    long  ticks;
+
+    FixedStepper(float tick_rate = default_tick_rate, int max_steps = default_max_catch_up) {
+        tick_dt = 1.f/tick_rate;
+        accumulator = 0.f;
+        max_catch_up = max_steps;
+        ticks = 0;
+    }
+
+    // Runs the ticks owed for frame_dt, at most max_catch_up of them.
+    // Time past the cap is dropped, the game slows down instead of
+    // spiralling. Returns the ticks run.
+    int advance(PhysicsWorld *world, float frame_dt, const function<void(float)> &step) {
+        accumulator += frame_dt;
+
+        int steps = 0;
+        while(accumulator >= tick_dt && steps < max_catch_up) {
+            previous_x.assign(world->balls.x.begin(), world->balls.x.end());
+            previous_y.assign(world->balls.y.begin(), world->balls.y.end());
+            step(tick_dt);
+            accumulator -= tick_dt;
+            steps++;
+            ticks++;
+        }
+        if(steps == max_catch_up && accumulator >= tick_dt) {
+            accumulator = 0.f;
+        }
+        return steps;
+    }
+
+    // How far the next tick has progressed, 0 to 1
+    float alpha() const {
+        return accumulator/tick_dt;
+    }
+
+    Vector2<float> interpolated_position(const PhysicsWorld *world, size_t i) const {
+        Vector2<float> current = world->balls.position(i);
+        if(i >= previous_x.size()) return current;
+
+        Vector2<float> previous = {previous_x[i], previous_y[i]};
+        return previous + (current - previous)*alpha();
+    }
+};
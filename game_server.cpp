@@ -0,0 +1,277 @@
+#include <algorithm>
+#include <cstdio>
+#include <cmath>
+#include "game_server.hpp"
+
+using namespace std;
+
+GameServer::GameServer(size_t threads, float tick_rate) {
+    if(threads == 0) threads = max(1u, thread::hardware_concurrency());
+    tick_dt = 1.f/tick_rate;
+    slice_ticks = 60;
+    max_shot_ticks = (long)(tick_rate*60);
+    latency_window = 4096;
+
+    next_id = 1;
+    runnable = 0;
+    stopping = false;
+    ticks_run = 0;
+    shots_done = 0;
+    queued_shots = 0;
+    latency_next = 0;
+    stats_time = chrono::steady_clock::now();
+    stats_ticks = 0;
+    stats_shots = 0;
+
+    for(size_t i = 0; i < threads; i++) {
+        workers.emplace_back(&GameServer::run, this);
+    }
+}
+
+GameServer::~GameServer() {
+    {
+        lock_guard<mutex> guard(queue_lock);
+        stopping = true;
+    }
+    queue_wake.notify_all();
+    for(auto &worker : workers) {
+        worker.join();
+    }
+}
+
+shared_ptr<ServerGame> GameServer::find(long id) {
+    lock_guard<mutex> guard(games_lock);
+    auto found = games.find(id);
+    return found == games.end() ? nullptr : found->second;
+}
+
+// Games
+
+long GameServer::create(unsigned seed, function<void(const string &)> reply) {
+    auto game = make_shared<ServerGame>();
+    setup_standard_table(&game->world, seed);
+    game->playing = false;
+    game->shot_ticks = 0;
+    game->shots_played = 0;
+    game->scheduled = false;
+    game->closed = false;
+    game->reply = move(reply);
+
+    lock_guard<mutex> guard(games_lock);
+    game->id = next_id++;
+    games[game->id] = game;
+    return game->id;
+}
+
+bool GameServer::close(long id) {
+    shared_ptr<ServerGame> game;
+    {
+        lock_guard<mutex> guard(games_lock);
+        auto found = games.find(id);
+        if(found == games.end()) return false;
+        game = found->second;
+        games.erase(found);
+    }
+    // A worker holding it drops it at the end of its slice
+    lock_guard<mutex> guard(game->lock);
+    queued_shots -= game->shots.size();
+    game->shots.clear();
+    game->closed = true;
+    return true;
+}
+
+bool GameServer::rack(long id, unsigned seed) {
+    shared_ptr<ServerGame> game = find(id);
+    if(!game) return false;
+    lock_guard<mutex> guard(game->lock);
+    if(game->playing || !game->shots.empty()) return false;
+    game->world.rack(seed);
+    return true;
+}
+
+long GameServer::shoot(long id, Vector2<float> velocity) {
+    if(!isfinite(velocity.x) || !isfinite(velocity.y)) return -2;
+    shared_ptr<ServerGame> game = find(id);
+    if(!game) return -1;
+    lock_guard<mutex> guard(game->lock);
+    game->shots.push_back({velocity, chrono::steady_clock::now()});
+    queued_shots++;
+    schedule(game);
+    return game->shots.size();
+}
+
+bool GameServer::describe(long id, string *out) {
+    shared_ptr<ServerGame> game = find(id);
+    if(!game) return false;
+    lock_guard<mutex> guard(game->lock);
+    const BallStore &balls = game->world.balls;
+    char item[64];
+    out->clear();
+    for(size_t i = 0; i < balls.size(); i++) {
+        snprintf(item, sizeof(item), "%s%g %g %d", i ? " " : "", balls.x[i], balls.y[i], balls.pocket[i]);
+        *out += item;
+    }
+    return true;
+}
+
+// Scheduler
+
+void GameServer::schedule(const shared_ptr<ServerGame> &game) {
+    if(game->scheduled) return;
+    game->scheduled = true;
+    {
+        lock_guard<mutex> guard(queue_lock);
+        run_queue.push_back(game);
+        runnable++;
+    }
+    queue_wake.notify_one();
+}
+
+void GameServer::run() {
+    while(true) {
+        shared_ptr<ServerGame> game;
+        {
+            unique_lock<mutex> guard(queue_lock);
+            queue_wake.wait(guard, [this] { return stopping || !run_queue.empty(); });
+            if(stopping) return;
+            game = move(run_queue.front());
+            run_queue.pop_front();
+        }
+        play(game);
+    }
+}
+
+// One slice of a game's work, then back on the queue or off it
+void GameServer::play(const shared_ptr<ServerGame> &game) {
+    bool again;
+    {
+        lock_guard<mutex> guard(game->lock);
+        PhysicsWorld &world = game->world;
+        if(!game->closed && !game->playing && !game->shots.empty()) {
+            game->current = game->shots.front();
+            game->shots.pop_front();
+            queued_shots--;
+            game->pocketed_before.resize(world.balls.size());
+            for(size_t i = 0; i < world.balls.size(); i++) {
+                game->pocketed_before[i] = world.balls.is_pocketed(i);
+            }
+            // A shot while balls still roll or with the cue ball down is dropped
+            game->struck = world.none_moving() && !world.balls.is_pocketed(0);
+            if(game->struck) {
+                world.balls.set_velocity(0, game->current.velocity);
+                world.wake(0);
+            }
+            game->playing = true;
+            game->shot_ticks = 0;
+        }
+
+        if(!game->closed && game->playing) {
+            int ticks = 0;
+            while(ticks < slice_ticks && !world.none_moving() && game->shot_ticks < max_shot_ticks) {
+                world.update(tick_dt);
+                ticks++;
+                game->shot_ticks++;
+            }
+            ticks_run += ticks;
+            if(world.none_moving() || game->shot_ticks >= max_shot_ticks) finish_shot(game.get());
+        }
+
+        again = !game->closed && (game->playing || !game->shots.empty());
+        game->scheduled = again;
+    }
+
+    lock_guard<mutex> guard(queue_lock);
+    if(again) {
+        run_queue.push_back(game);
+        queue_wake.notify_one();
+        return;
+    }
+    if(--runnable == 0) idle.notify_all();
+}
+
+// Call with game->lock held
+void GameServer::finish_shot(ServerGame *game) {
+    PhysicsWorld &world = game->world;
+    game->playing = false;
+    game->shots_played++;
+
+    // Cut off at max_shot_ticks, everything stops where it is
+    bool stopped = !world.none_moving();
+    if(stopped) {
+        BallStore &balls = world.balls;
+        for(size_t i = 0; i < balls.size(); i++) {
+            balls.set_velocity(i, {0.f, 0.f});
+            balls.flags[i] &= ~(uint32_t)BALL_MOVING;
+        }
+    }
+
+    string pocketed;
+    for(size_t i = 0; i < world.balls.size(); i++) {
+        if(!world.balls.is_pocketed(i) || game->pocketed_before[i]) continue;
+        pocketed += (pocketed.empty() ? "" : ",") + to_string(i);
+    }
+    // Scratch, the cue ball goes back on its spot for the next shot
+    bool scratch = world.balls.is_pocketed(0);
+    if(scratch) world.respot_ball(0, {0, line_distance});
+
+    double latency_ms = chrono::duration<double, milli>(chrono::steady_clock::now() - game->current.queued).count();
+    shots_done++;
+    {
+        lock_guard<mutex> guard(metrics_lock);
+        if(latencies.size() < latency_window) latencies.push_back(latency_ms);
+        else latencies[latency_next] = latency_ms;
+        latency_next = (latency_next + 1) % latency_window;
+    }
+
+    string line = "done " + to_string(game->id) + " " + to_string(game->shots_played) + " ticks " + to_string(game->shot_ticks) +
+                  " pocketed " + (pocketed.empty() ? "-" : pocketed) + (scratch ? " scratch" : "") + (stopped ? " stopped" : "");
+    if(!game->struck) line = "dropped " + to_string(game->id) + " " + to_string(game->shots_played);
+    char latency[48];
+    snprintf(latency, sizeof(latency), " latency_ms %.3f", latency_ms);
+    if(game->reply) game->reply(line + latency);
+}
+
+// Metrics
+
+ServerStats GameServer::stats() {
+    ServerStats result;
+    {
+        lock_guard<mutex> guard(games_lock);
+        result.games = games.size();
+    }
+    {
+        lock_guard<mutex> guard(queue_lock);
+        result.run_queue = run_queue.size();
+    }
+    result.queued_shots = queued_shots;
+
+    vector<double> sorted;
+    auto now = chrono::steady_clock::now();
+    long ticks = ticks_run, shots = shots_done;
+    {
+        lock_guard<mutex> guard(metrics_lock);
+        sorted = latencies;
+        double seconds = max(1e-9, chrono::duration<double>(now - stats_time).count());
+        result.ticks_per_sec = (ticks - stats_ticks)/seconds;
+        result.shots_per_sec = (shots - stats_shots)/seconds;
+        stats_time = now;
+        stats_ticks = ticks;
+        stats_shots = shots;
+    }
+    result.sim_seconds_per_sec = result.ticks_per_sec*tick_dt;
+
+    sort(sorted.begin(), sorted.end());
+    auto percentile = [&](double p) {
+        return sorted.empty() ? 0. : sorted[min(sorted.size() - 1, (size_t)(p*sorted.size()))];
+    };
+    result.latency_p50_ms = percentile(.5);
+    result.latency_p90_ms = percentile(.9);
+    result.latency_p99_ms = percentile(.99);
+    result.latency_max_ms = sorted.empty() ? 0. : sorted.back();
+    return result;
+}
+
+void GameServer::wait_idle() {
+    unique_lock<mutex> guard(queue_lock);
+    idle.wait(guard, [this] { return runnable == 0; });
+}
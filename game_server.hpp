@@ -0,0 +1,137 @@
+#include <vector>
+#include <deque>
+#include <map>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <chrono>
+#include "physics.hpp"
+#include "fixed_step.hpp"
+
+#pragma once
+
+using namespace std;
+
+struct ServerShot {
+    Vector2<float> velocity;
+    chrono::steady_clock::time_point queued;
+};
+
+// One game: its own table and the shots waiting for it. Everything but
+// id and reply is guarded by lock.
+struct ServerGame {
+    long              id;
+    PhysicsWorld      world;
+    deque<ServerShot> shots;
+    // The shot on the table, and the ticks it has run so far
+    bool              playing;
+    ServerShot        current;
+    // The current shot hit the cue ball, false when it was dropped
+    bool              struck;
+    long              shot_ticks;
+    long              shots_played;
+    vector<uint8_t>   pocketed_before;
+    // In the run queue or on a worker
+    bool              scheduled;
+    bool              closed;
+    mutex             lock;
+    // Where this game's results go, called from a worker
+    function<void(const string &)> reply;
+};
+
+struct ServerStats {
+    size_t games;
+    long   queued_shots;
+    // Games waiting for a worker
+    size_t run_queue;
+    // Simulated seconds per wall second, so how many games could be
+    // played in real time by this process
+    double sim_seconds_per_sec;
+    double ticks_per_sec;
+    double shots_per_sec;
+    // From a shot being queued to its balls resting, over recent shots
+    double latency_p50_ms, latency_p90_ms, latency_p99_ms, latency_max_ms;
+};
+
+// Many independent games in one process. A game with a shot to play goes
+// on a FIFO run queue, a worker takes it, plays slice_ticks ticks and
+// puts it back at the end if the shot is still going or another is
+// waiting. Every game with work gets a turn before any gets a second,
+// so one long shot cannot hold back the rest. ThreadPool takes the
+// newest task first, which suits a batch but not this.
+
+class GameServer {
+    private:
+    mutex                             games_lock;
+    map<long, shared_ptr<ServerGame>> games;
+    long                              next_id;
+
+    mutex                          queue_lock;
+    condition_variable             queue_wake;
+    condition_variable             idle;
+    deque<shared_ptr<ServerGame>>  run_queue;
+    // Games scheduled, queued or on a worker
+    long                           runnable;
+    bool                           stopping;
+    vector<thread>                 workers;
+
+    atomic<long> ticks_run;
+    atomic<long> shots_done;
+    atomic<long> queued_shots;
+
+    // Latencies of the last latency_window shots, in a ring
+    mutex          metrics_lock;
+    vector<double> latencies;
+    size_t         latency_next;
+    chrono::steady_clock::time_point stats_time;
+    long           stats_ticks, stats_shots;
+
+    shared_ptr<ServerGame> find(long id);
+    // Call with game->lock held
+    void schedule(const shared_ptr<ServerGame> &game);
+    void run();
+    void play(const shared_ptr<ServerGame> &game);
+    void finish_shot(ServerGame *game);
+
+    public:
+    float  tick_dt;
+    int    slice_ticks;
+    // A shot still moving after this many ticks is stopped where it is,
+    // every ball at rest
+    long   max_shot_ticks;
+    size_t latency_window;
+
+    // 0 threads means one per hardware thread
+    GameServer(size_t threads = 0, float tick_rate = default_tick_rate);
+    ~GameServer();
+
+    GameServer(const GameServer &) = delete;
+    GameServer &operator=(const GameServer &) = delete;
+
+    size_t threads() const {
+        return workers.size();
+    }
+
+    // A standard table racked from seed, returns its id
+    long create(unsigned seed, function<void(const string &)> reply);
+    // Queued shots are dropped, one being played stops after its slice
+    bool close(long id);
+    // Only between shots, false while one is queued or playing
+    bool rack(long id, unsigned seed);
+    // Shots queue up behind each other, returns the queue depth, -1
+    // without such a game or -2 for a velocity that is not finite. A shot
+    // taken while balls roll or with the cue ball down is replied to as
+    // dropped rather than done.
+    long shoot(long id, Vector2<float> velocity);
+    // Every ball as "x y pocket", ball 0 first
+    bool describe(long id, string *out);
+
+    // Rates cover the time since the previous call
+    ServerStats stats();
+    // Blocks until no game has a shot left
+    void wait_idle();
+};
@@ -4,9 +4,17 @@
 #include <vector>
 #include <algorithm>
 #include <stdlib.h>
+#include <cstring>
+#include <ctime>
 #include <thread>
+#include <chrono>
+#include <memory>
 #include <SFML/Graphics.hpp>
 #include "classes.hpp"
+#include "simulation.hpp"
+#include "asset_cache.hpp"
+#include "scenario.hpp"
+#include "thread_pool.hpp"
 
 using namespace std;
 
@@ -17,13 +25,14 @@ const int window_height = 1000;
 
 const float default_zoom = 2.f;
 
-const int sub_updates = 8;
-
-const int ball_size = 25;
-const int ball_mass = 100;
-const float friction = 1.f;
 const float power_multiplier = 2.f;
-const float line_distance = 422;
+
+// Asset cache, and what it is rebuilt from
+const char *const default_asset_cache = "billiards_assets.cache";
+const char *const font_path = "arial.ttf";
+const char *const table_image_path = "pool_table_nobg.png";
+const float ball_bake_scale = 2.f;
+const int ball_sprite_count = 16;
 const sf::Color color_order[7] = {
     sf::Color(227, 211, 36, 255), // yellow 
     sf::Color::Blue, 
@@ -33,219 +42,169 @@ const sf::Color color_order[7] = {
     sf::Color(48, 160, 67, 255), // green
     sf::Color(148, 30, 30, 255) // dark red
 };
-const Vector2<float> line_points[] = {
-    // Top
-    {-417.f, -906.f}, {-347.f, -838.f},
-    {-347.f, -838.f}, {347.f, -838.f},
-    {347.f, -838.f}, {417.f, -906.f},
-
-    // Bottom
-    {417.f, 906.f}, {347.f, 838.f},
-    {347.f, 838.f}, {-347.f, 838.f},
-    {-347.f, 838.f}, {-417.f, 906.f},
-
-    // Lower Left
-    {-495.f, 828.f}, {-425.f, 760.f},
-    {-425.f, 760.f}, {-425.f, 60.f},
-    {-425.f, 60.f}, {-460.f, 47.f},
-
-    // Upper Left
-    {-460.f, -47.f}, {-425.f, -60.f},
-    {-425.f, -60.f}, {-425.f, -760.f},
-    {-425.f, -760.f}, {-495.f, -828.f},
-
-    // Upper Right
-    {495.f, -828.f}, {425.f, -760.f},
-    {425.f, -760.f}, {425.f, -60.f}, 
-    {425.f, -60.f}, {460.f, -47.f}, 
-
-    // Lower Right
-    {460.f, 47.f}, {425.f, 60.f}, 
-    {425.f, 60.f}, {425.f, 760.f}, 
-    {425.f, 760.f}, {495.f, 828.f}
-};
-const int triangle_ordering[15] = {
-        1,
-      0,  1, 
-    1,  8,  0,
-  0,  1,  0,  1,
-1,  0,  0,  1,  0
-};
 
-bool within_ball(Vector2<float> position, Ball ball) {
-    return distance(position, ball.position) <= ball_size;
+bool within_ball(Vector2<float> position, Vector2<float> ball_position) {
+    return distance(position, ball_position) <= ball_size;
 }
 
-vector<Ball*> generate_all_balls(vector<bool*> *balls_moving, sf::Font *font) {
-    vector<Ball*> all_balls;
+vector<BallSprite> generate_all_sprites(sf::Font *font) {
+    vector<BallSprite> all_sprites;
     // White ball
-    all_balls.push_back(new Ball(0.f, 0.f, ball_size, ball_mass, friction, false, WHITE, 0, font));
-    balls_moving->push_back(&(all_balls.back()->is_moving));
+    all_sprites.push_back(BallSprite(ball_size, false, WHITE, 0, font));
 
     // Solid balls
     for(int i = 1; i <= 7; i++) {
-        all_balls.push_back(new Ball(0.f, 0.f, ball_size, ball_mass, friction, false, color_order[i-1], i, font));
-        balls_moving->push_back(&(all_balls.back()->is_moving));
+        all_sprites.push_back(BallSprite(ball_size, false, color_order[i-1], i, font));
     }
-    
+
     // Black 8 ball
-    all_balls.push_back(new Ball(0.f, 0.f, ball_size, ball_mass, friction, false, sf::Color::Black, 8, font));
-    balls_moving->push_back(&(all_balls.back()->is_moving));
+    all_sprites.push_back(BallSprite(ball_size, false, sf::Color::Black, 8, font));
 
     // Striped balls
     for(int i = 1; i <= 7; i++) {
-        all_balls.push_back(new Ball(0.f, 0.f, ball_size, ball_mass, friction, true, color_order[i-1], i+8, font));
-        balls_moving->push_back(&(all_balls.back()->is_moving));
+        all_sprites.push_back(BallSprite(ball_size, true, color_order[i-1], i+8, font));
     }
 
-    return all_balls;
+    return all_sprites;
 }
 
 Vector2<float> window_position_transform(Vector2<float> position, Vector2<float> translate, float zoom) {
     return ((position - Vector2<float>{(float)window_width/2, (float)window_height/2})*zoom + translate);
 }
 
-//Creation of Ball Triangle Positioning
-void triangle(float x, float y, vector<Ball*> *all_balls) {
-    int index = 0;
-    float ball_spacing_x = ball_size;
-    float ball_spacing_y = -sinf(PI*2/3)*ball_size*2;
-
-    srand(static_cast<unsigned>(time(nullptr))); //Randomize based on time
-
-    vector<int> solid = {1, 2, 3, 4, 5, 6, 7};
-    random_shuffle(solid.begin(), solid.end());
-    vector<int> striped = {9, 10, 11, 12, 13, 14, 15};
-    random_shuffle(striped.begin(), striped.end());
-
-    vector<int> shuffledNumbers;
-    for(int i : triangle_ordering) {
-        switch(i) {
-            case 0: {
-                shuffledNumbers.push_back(solid.back());
-                solid.pop_back();
-                break;
-            }
-            case 1: {
-                shuffledNumbers.push_back(striped.back());
-                striped.pop_back();
-                break;
-            }
-            default: {
-                shuffledNumbers.push_back(8);
-                break;
-            }
+int main(int argc, char **argv)
+{
+    auto process_start = chrono::steady_clock::now();
+
+    // Stress mode: --stress <balls> fills a scaled up table
+    // Table and balls from a scenario file: --scenario <file>
+    // Event-driven physics: --events
+    // Physics ticks per second: --tick-rate <hz>
+    // Fixed rack: --seed <n>
+    // Profiler trace written on exit and on F4: --trace <file>
+    // Physics on the render thread instead of its own: --serial
+    // Every shot saved to <prefix>_<n>.traj: --record <prefix>
+    // Watch a recording, space pauses, left/right seek a second: --replay <file>
+    // Assets from another cache file: --asset-cache <file>, or decoded every start: --no-asset-cache
+    // Rebuild the asset cache and exit, for build scripts: --bake-assets
+    // Time from start to the first frame on stdout: --startup-time
+    // Sub-steps per tick from the fastest ball instead of always 8: --adaptive-steps
+    // Kiosk: sleep until input while the table rests, vsync otherwise: --idle-wait
+    // Contacts through the coloured solver, big colours over a thread pool: --colored-contacts
+    int      stress_balls = 0;
+    bool     event_driven = false;
+    bool     serial       = false;
+    string   record_prefix;
+    string   replay_path;
+    string   scenario_path;
+    float    tick_rate    = default_tick_rate;
+    unsigned seed         = time(nullptr);
+    string   trace_path   = "billiards_trace.json";
+    bool     trace_on_exit = false;
+    string   asset_cache_path = default_asset_cache;
+    bool     use_asset_cache  = true;
+    bool     bake_assets      = false;
+    bool     startup_time     = false;
+    bool     adaptive_steps   = false;
+    bool     idle_wait        = false;
+    bool     colored_contacts = false;
+    for(int i = 1; i < argc; i++) {
+        if(strcmp(argv[i], "--stress") == 0 && i + 1 < argc) stress_balls = atoi(argv[i+1]);
+        if(strcmp(argv[i], "--events") == 0) event_driven = true;
+        if(strcmp(argv[i], "--serial") == 0) serial = true;
+        if(strcmp(argv[i], "--record") == 0 && i + 1 < argc) record_prefix = argv[i+1];
+        if(strcmp(argv[i], "--replay") == 0 && i + 1 < argc) replay_path = argv[i+1];
+        if(strcmp(argv[i], "--scenario") == 0 && i + 1 < argc) scenario_path = argv[i+1];
+        if(strcmp(argv[i], "--tick-rate") == 0 && i + 1 < argc) tick_rate = max(1.f, (float)atof(argv[i+1]));
+        if(strcmp(argv[i], "--seed") == 0 && i + 1 < argc) seed = strtoul(argv[i+1], nullptr, 10);
+        if(strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+            trace_path = argv[i+1];
+            trace_on_exit = true;
         }
+        if(strcmp(argv[i], "--asset-cache") == 0 && i + 1 < argc) asset_cache_path = argv[i+1];
+        if(strcmp(argv[i], "--no-asset-cache") == 0) use_asset_cache = false;
+        if(strcmp(argv[i], "--bake-assets") == 0) bake_assets = true;
+        if(strcmp(argv[i], "--startup-time") == 0) startup_time = true;
+        if(strcmp(argv[i], "--adaptive-steps") == 0) adaptive_steps = true;
+        if(strcmp(argv[i], "--idle-wait") == 0) idle_wait = true;
+        if(strcmp(argv[i], "--colored-contacts") == 0) colored_contacts = true;
     }
-
-    float x_cur = x - 5*ball_size;
-    float y_cur = y;
-
-    for(int i = 1; i <= 5; i++) {
-        for(int k = 5 - i; k > 0; k--) {
-            x_cur += ball_spacing_x; //Create spacing
-        }
-        for(int j = 1; j <= i; j++) {
-            x_cur += ball_spacing_x;
-            (*all_balls)[shuffledNumbers[index]]->position = {x_cur, y_cur}; //Based on spacing position ball into location
-            x_cur += ball_spacing_x;
-            index++;
+    // Physics setup
+    PhysicsWorld world;
+    float table_scale = 1.f;
+    if(!scenario_path.empty()) {
+        string error;
+        if(!load_scenario(scenario_path, &world, &table_scale, &error)) {
+            fprintf(stderr, "%s: %s\n", scenario_path.c_str(), error.c_str());
+            return 1;
         }
-
-        y_cur += ball_spacing_y;
-        x_cur = x - 5*ball_size;
     }
-}
-
-void set_all_moving(vector<bool*> *balls_moving) {
-    for(auto moving_bool : *balls_moving) {
-        *moving_bool = true;
+    else if(stress_balls > 0) {
+        table_scale = stress_table_scale(stress_balls);
+        generate_stress_field(&world, stress_balls, table_scale, seed);
     }
-}
-
-bool none_moving(vector<bool*> *balls_moving) {
-    for(auto moving_bool : *balls_moving) {
-        if(*moving_bool) return false;
+    else {
+        setup_standard_table(&world, seed);
     }
-    return true;
-}
-
-void ball_line_collision(Ball *ball, Line *line) {
-    ball->velocity = reflect(ball->velocity, line->normal);
-}
-
-void check_ball_line_collision(vector<Ball*> *all_balls, vector<Line*> *all_lines) {
-    for(auto ball : *all_balls) {
-        for(auto line : *all_lines) {
-            if(line->collision(ball->position, ball->radius)) {
-                ball_line_collision(ball, line);
-            }
-        }
+    if(adaptive_steps) world.sub_step_mode = ADAPTIVE_SUB_STEPS;
+    // Outlives the simulation, which is the only one to use it
+    unique_ptr<ThreadPool> contact_pool;
+    if(colored_contacts) {
+        contact_pool = make_unique<ThreadPool>();
+        world.contact_mode = COLORED_CONTACTS;
+        world.contact_pool = contact_pool.get();
     }
-}
-
-void ball_to_ball_collision(vector<Ball*> *all_balls){
-    for(auto b1 : *all_balls) {
-        for(auto b2 : *all_balls) {
-            if(b1->number == b2->number) break;
 
-            float overshot = distance(b1->position, b2->position) - (b1->radius + b2->radius);
-
-            if (overshot <= 0) {
-                //Normalize
-                Vector2<float> normalize = unit(b1->position - b2->position);
-
-                //i Ball Velocity Vector
-                float dot_i = dot(b1->velocity, normalize);
-                Vector2<float> velocity_xi = normalize * dot_i;
-                Vector2<float> velocity_yi = b1->velocity - velocity_xi;
-
-                //j Ball Velocity Vector
-                float dot_j = dot(b2->velocity, normalize);
-                Vector2<float> velocity_xj = normalize * dot_j;
-                Vector2<float> velocity_yj = b2->velocity - velocity_xj;
-
-                //Velocities of both balls
-                Vector2<float> velocity_i = (velocity_xi * ((b1->mass - b2->mass)/(b1->mass + b2->mass))) + (velocity_xj * ((2 * b2->mass)/(b1->mass + b2->mass))) + velocity_yi;
-                Vector2<float> velocity_j = (velocity_xi * ((2 * b1->mass)/(b1->mass + b2->mass))) + (velocity_xj * ((b2->mass - b1->mass)/(b1->mass + b2->mass))) + velocity_yj;
-
-                b1->velocity = velocity_i;
-                b2->velocity = velocity_j;
-
-                Vector2<float> correction_overlap = normalize * overshot;
-                    
-                b1->position = b1->position - correction_overlap;
-                b2->position = b2->position + correction_overlap;
-            }
-        }
-    }
-}
-
-void sub_update(vector<Ball*> *all_balls, float dt) {
-    for(auto ball : *all_balls) {
-        ball->update(dt);
-    }
-}
-
-void update(vector<Ball*> *all_balls, vector<Line*> *all_lines, float dt) {
-    float sub_dt = dt / sub_updates;
-    for(int i = 0; i < sub_updates; i++) {
-        sub_update(all_balls, sub_dt);
-        ball_to_ball_collision(all_balls);
-        check_ball_line_collision(all_balls, all_lines);
-    }
-}
-
-int main()
-{
     Vector2<float> drag_start_position;
     Vector2<float> mouse_position;
 
     Vector2<float> translate  = {0.f, 0.f};
-    float          zoom       = default_zoom;
+    float          zoom       = default_zoom*table_scale;
     bool           lmb_toggle = false;
     bool           rmb_toggle = false;
-    vector<bool*>  balls_moving;
+
+    // Assets, mapped from the cache when it matches the source files.
+    // Otherwise the image is decoded and the balls drawn from the font
+    // and their shapes, then the cache is written for the next start.
+    AssetCache  asset_cache;
+    sf::Font    font;
+    bool        font_loaded = false;
+    sf::Image   image;
+    AssetPixels table_pixels;
+    unique_ptr<BallBatch> ball_batch;
+    uint64_t fingerprint = asset_fingerprint({font_path, table_image_path}, {ball_size, ball_bake_scale, (float)ball_sprite_count});
+    bool cached = use_asset_cache && !bake_assets && asset_cache.open(asset_cache_path, fingerprint);
+    if(cached) {
+        table_pixels = asset_cache.table();
+        AssetPixels atlas = asset_cache.balls();
+        ball_batch = make_unique<BallBatch>(atlas.pixels, atlas.width, atlas.height, asset_cache.ball_count(),
+                                            asset_cache.atlas_columns(), asset_cache.atlas_cell(), asset_cache.atlas_scale());
+    }
+    else {
+        font_loaded = font.loadFromFile(font_path);
+        image.loadFromFile(table_image_path);
+        table_pixels = {image.getPixelsPtr(), image.getSize().x, image.getSize().y};
+        vector<BallSprite> all_sprites = generate_all_sprites(&font);
+        ball_batch = make_unique<BallBatch>(all_sprites, ball_bake_scale);
+
+        if((use_asset_cache || bake_assets) && font_loaded && table_pixels.width > 0) {
+            sf::Image atlas = ball_batch->atlas_image();
+            AssetPixels atlas_pixels = {atlas.getPixelsPtr(), atlas.getSize().x, atlas.getSize().y};
+            if(!write_asset_cache(asset_cache_path, fingerprint, table_pixels, atlas_pixels, ball_batch->size(),
+                                  ball_batch->atlas_columns(), ball_batch->atlas_cell(), ball_batch->atlas_scale())) {
+                fprintf(stderr, "could not write %s\n", asset_cache_path.c_str());
+                if(bake_assets) return 1;
+            }
+        }
+        else if(bake_assets) {
+            fprintf(stderr, "could not load %s and %s\n", font_path, table_image_path);
+            return 1;
+        }
+    }
+    if(bake_assets) {
+        printf("wrote %s\n", asset_cache_path.c_str());
+        return 0;
+    }
 
     // Settings
     sf::ContextSettings settings;
@@ -253,6 +212,7 @@ int main()
 
     // Window
     sf::RenderWindow window(sf::VideoMode(window_width, window_height), "billiards", sf::Style::Default, settings);
+    window.setVerticalSyncEnabled(idle_wait);
 
     // View
     sf::View view;
@@ -264,43 +224,67 @@ int main()
     // Clock
     sf::Clock clock;
 
-    // Font
-    sf::Font font;
-    font.loadFromFile("arial.ttf");
-
-    // Image
-    sf::Image image;
-    image.loadFromFile("pool_table_nobg.png");
-
-    // Ball setup
-    Table table = Table({0.f, 0.f}, 1.f, {423.5f, -834.5f}, {475.f, 0.f}, ball_size*2, &image);
-    vector<Ball*> all_balls = generate_all_balls(&balls_moving, &font);
-    triangle(0, -422, &all_balls);
-    all_balls[0]->position = {0, line_distance};
-    
-    // Line setup
-    vector<Line*> all_lines;
-    for(int i = 0; i < size(line_points); i += 2) {
-        all_lines.push_back(new Line(line_points[i], line_points[i+1]));
+    Simulation simulation(world, tick_rate, event_driven);
+    if(!record_prefix.empty()) simulation.record_shots(record_prefix);
+
+    // Replay
+    TrajectoryReader replay;
+    float replay_time   = 0.f;
+    bool  replay_paused = false;
+    if(!replay_path.empty() && !replay.open(replay_path)) {
+        fprintf(stderr, "could not open %s\n", replay_path.c_str());
+        return 1;
     }
 
+    // Predicted path of the shot under the mouse, F5 hides it
+    ShotPreview preview(world, tick_rate);
+    ShotPreviewOverlay preview_overlay(ball_size);
+
+    // Table setup, the pixels are on the GPU after this
+    Table table = Table({0.f, 0.f}, table_scale, world.pockets, world.pocket_radius,
+                        table_pixels.pixels, table_pixels.width, table_pixels.height);
+    asset_cache.close();
+
+    // Profiler, F3 shows the overlay and F4 writes the trace. The font is
+    // only loaded once the overlay is first shown if the balls came cached.
+    Profiler profiler;
+    set_profiler(&profiler);
+    ProfilerOverlay overlay(&font);
+
+    // Cushion debug lines, baked into the table layer when F2 turns them on
+    table.set_lines(world.lines);
+
+    // Physics ticks on its own thread unless --serial
+    if(!serial && !replay.is_open()) simulation.start();
+
+    // With --idle-wait the loop blocks on the next event once a frame has
+    // drawn the table at rest, until then it draws every frame. A shot
+    // keeps it drawing until a snapshot after the shot arrives.
+    bool idle = false;
+    long shot_tick = -1;
+
     // Loop to run the game
     while (window.isOpen())
     {
+        profiler.begin_frame();
         sf::Event event;
 
         // Checking events
-        while (window.pollEvent(event))
+        uint64_t poll_start = profiler.now_ns();
+        bool waited = idle && window.waitEvent(event);
+        if(waited) clock.restart();
+        while (waited || window.pollEvent(event))
         {
+            waited = false;
             switch(event.type) {
                 case sf::Event::Closed: {
                     window.close();
                     break;
                 }
                 case sf::Event::MouseWheelMoved: {
-                    zoom -= event.mouseWheel.delta/10.f;
-                    zoom = max(.5f, zoom);
-                    zoom = min(5.f, zoom);
+                    zoom -= event.mouseWheel.delta/10.f*table_scale;
+                    zoom = max(.5f*table_scale, zoom);
+                    zoom = min(5.f*table_scale, zoom);
                     view.setSize(window_width*zoom, window_height*zoom);
                     break;
                 }
@@ -308,12 +292,15 @@ int main()
                     if (event.mouseButton.button == sf::Mouse::Left) {
                         
                         if(rmb_toggle) break;
-                        if(!none_moving(&balls_moving)) break;
+                        if(replay.is_open()) break;
+                        const WorldSnapshot &snapshot = simulation.latest();
+                        if(!snapshot.none_moving) break;
                         sf::Vector2i tmp = sf::Mouse::getPosition(window);
                       
                         mouse_position = window_position_transform({(float)tmp.x, (float)tmp.y}, translate, zoom);
-                        all_balls[0]->velocity = (mouse_position - all_balls[0]->position)*power_multiplier;
-                        set_all_moving(&balls_moving);
+                        if(simulation.send({SIM_SHOOT, (mouse_position - snapshot.position(0))*power_multiplier})) {
+                            shot_tick = snapshot.tick;
+                        }
                         lmb_toggle = true;
                     }
                     if (event.mouseButton.button == sf::Mouse::Right) {
@@ -339,8 +326,41 @@ int main()
                             window.close();
                             break;
                         }
+                        case sf::Keyboard::Space: {
+                            replay_paused = !replay_paused;
+                            break;
+                        }
+                        case sf::Keyboard::Left: {
+                            replay_time = max(0.f, replay_time - 1.f);
+                            break;
+                        }
+                        case sf::Keyboard::Right: {
+                            replay_time += 1.f;
+                            break;
+                        }
+                        case sf::Keyboard::Home: {
+                            replay_time = 0.f;
+                            break;
+                        }
+                        case sf::Keyboard::F2: {
+                            table.show_lines = !table.show_lines;
+                            break;
+                        }
+                        case sf::Keyboard::F3: {
+                            overlay.visible = !overlay.visible;
+                            if(!font_loaded) font_loaded = font.loadFromFile(font_path);
+                            break;
+                        }
+                        case sf::Keyboard::F4: {
+                            if(profiler.write_chrome_trace(trace_path)) printf("wrote %s\n", trace_path.c_str());
+                            break;
+                        }
+                        case sf::Keyboard::F5: {
+                            preview_overlay.visible = !preview_overlay.visible;
+                            break;
+                        }
                         case sf::Keyboard::R: {
-                            zoom = default_zoom;
+                            zoom = default_zoom*table_scale;
                             translate = {0, 0};
                             view.setSize(window_width*zoom, window_height*zoom);
                             view.setCenter(0, 0);
@@ -357,6 +377,8 @@ int main()
                 }
             }
         }
+        profiler.record("poll_events", poll_start, profiler.now_ns());
+
         if(rmb_toggle) {
             sf::Vector2i tmp = sf::Mouse::getPosition(window);
             mouse_position = window_position_transform({(float)tmp.x, (float)tmp.y}, {0, 0}, zoom);
@@ -364,33 +386,86 @@ int main()
             view.setCenter(translate.x, translate.y);
         }
         // Updates
-        float dt = clock.restart().asSeconds();
-        update(&all_balls, &all_lines, dt);
+        float frame_dt = clock.restart().asSeconds();
+        {
+            PROFILE_SCOPE("physics");
+            simulation.pump(frame_dt);
+        }
+        simulation.collect_profile(&profiler);
+        const WorldSnapshot &snapshot = simulation.latest();
+        float alpha = simulation.alpha(snapshot);
+        if(replay.is_open()) {
+            float length = replay.tick_count()*replay.tick_dt();
+            if(!replay_paused) replay_time += frame_dt;
+            replay_time = min(replay_time, length);
+            replay.seek_time(replay_time);
+        }
+
+        // Aim preview, only asked for again when the aim moved enough
+        bool aiming = preview_overlay.visible && !replay.is_open() && snapshot.none_moving && !snapshot.is_pocketed(0);
+        if(aiming) {
+            sf::Vector2i tmp = sf::Mouse::getPosition(window);
+            Vector2<float> aim_position = window_position_transform({(float)tmp.x, (float)tmp.y}, translate, zoom);
+            preview.aim(snapshot.x, snapshot.y, snapshot.flags, (aim_position - snapshot.position(0))*power_multiplier);
+        }
 
         // Reset window
         window.clear(sf::Color(50, 150, 150, 255));
         window.setView(view);
         
         // Drawing
-        table.draw(&window);
-        for(Ball* ball : all_balls) {
-            ball->draw(&window);
+        {
+            PROFILE_SCOPE("Table::draw");
+            table.draw(&window);
+        }
+        if(aiming) {
+            PROFILE_SCOPE("shot_preview");
+            const ShotPrediction &prediction = preview.latest();
+            if(prediction.table_version == preview.table_version()) preview_overlay.draw(&window, prediction);
+        }
+        {
+            PROFILE_SCOPE("ball_draws");
+            ball_batch->clear();
+            if(replay.is_open()) {
+                for(size_t i = 0; i < replay.ball_count(); i++) {
+                    if(replay.is_pocketed(i)) continue;
+                    ball_batch->add(i % ball_batch->size(), replay.position(i));
+                }
+            }
+            else {
+                for(size_t i = 0; i < snapshot.size(); i++) {
+                    if(snapshot.is_pocketed(i)) continue;
+                    ball_batch->add(i % ball_batch->size(), snapshot.interpolated_position(i, alpha));
+                }
+            }
+            ball_batch->draw(&window);
         }
-        for(Line* line : all_lines) {
-            // line->draw(&window);
+        overlay.draw(&window, profiler);
+
+        // Nothing on screen changes until input once the table rests, the
+        // shot preview has caught up and no replay or drag is running
+        if(idle_wait) {
+            idle = snapshot.none_moving && snapshot.tick > shot_tick && (!aiming || preview.caught_up()) &&
+                   !replay.is_open() && !rmb_toggle && !overlay.visible;
         }
 
         // Display
-        window.display();   
-    }
-
+        {
+            PROFILE_SCOPE("display");
+            window.display();
+        }
+        profiler.end_frame();
 
-    // Clean up
-    for(auto ball : all_balls) {
-        delete ball;
+        if(startup_time) {
+            double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - process_start).count();
+            printf("first frame after %.1f ms, assets %s\n", ms, cached ? "mapped from cache" : "decoded");
+            startup_time = false;
+        }
     }
-    for(auto line : all_lines) {
-        delete line;
+
+    if(trace_on_exit && !profiler.write_chrome_trace(trace_path)) {
+        fprintf(stderr, "could not write %s\n", trace_path.c_str());
     }
+
     return 0;
 }
\ No newline at end of file
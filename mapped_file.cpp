@@ -0,0 +1,66 @@
+#include "mapped_file.hpp"
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile() {
+    data = nullptr;
+    length = 0;
+    mapping = nullptr;
+}
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+bool MappedFile::open(const string &path) {
+    close();
+
+#ifdef _WIN32
+    HANDLE handle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if(handle == INVALID_HANDLE_VALUE) return false;
+    LARGE_INTEGER size;
+    GetFileSizeEx(handle, &size);
+    HANDLE view = size.QuadPart > 0 ? CreateFileMappingA(handle, nullptr, PAGE_READONLY, 0, 0, nullptr) : nullptr;
+    CloseHandle(handle);
+    if(!view) return false;
+    data = (const uint8_t *)MapViewOfFile(view, FILE_MAP_READ, 0, 0, 0);
+    mapping = view;
+    length = size.QuadPart;
+#else
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if(fd < 0) return false;
+    struct stat info;
+    if(fstat(fd, &info) != 0 || info.st_size == 0) {
+        ::close(fd);
+        return false;
+    }
+    void *mapped = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if(mapped == MAP_FAILED) return false;
+    data = (const uint8_t *)mapped;
+    length = info.st_size;
+#endif
+    if(!data) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+void MappedFile::close() {
+#ifdef _WIN32
+    if(data) UnmapViewOfFile(data);
+    if(mapping) CloseHandle((HANDLE)mapping);
+#else
+    if(data) munmap((void *)data, length);
+#endif
+    data = nullptr;
+    mapping = nullptr;
+    length = 0;
+}
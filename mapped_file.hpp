@@ -0,0 +1,38 @@
+#include <string>
+#include <cstddef>
+#include <cstdint>
+
+#pragma once
+
+using namespace std;
+
+// A whole file mapped read-only, for formats read straight from the
+// page cache without copying into buffers of our own
+
+class MappedFile {
+    private:
+    const uint8_t *data;
+    size_t         length;
+    void          *mapping;
+
+    public:
+    MappedFile();
+    ~MappedFile();
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    // Fails on a missing or empty file
+    bool open(const string &path);
+    void close();
+    bool is_open() const {
+        return data != nullptr;
+    }
+
+    const uint8_t *bytes() const {
+        return data;
+    }
+    size_t size() const {
+        return length;
+    }
+};
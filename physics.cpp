@@ -0,0 +1,437 @@
+#include <algorithm>
+#include <random>
+#include "physics.hpp"
+#include "profiler.hpp"
+#include "physics_kernels.hpp"
+
+using namespace std;
+
+// Table geometry
+
+const Vector2<float> line_points[] = {
+    // Top
+    {-417.f, -906.f}, {-347.f, -838.f},
+    {-347.f, -838.f}, {347.f, -838.f},
+    {347.f, -838.f}, {417.f, -906.f},
+
+    // Bottom
+    {417.f, 906.f}, {347.f, 838.f},
+    {347.f, 838.f}, {-347.f, 838.f},
+    {-347.f, 838.f}, {-417.f, 906.f},
+
+    // Lower Left
+    {-495.f, 828.f}, {-425.f, 760.f},
+    {-425.f, 760.f}, {-425.f, 60.f},
+    {-425.f, 60.f}, {-460.f, 47.f},
+
+    // Upper Left
+    {-460.f, -47.f}, {-425.f, -60.f},
+    {-425.f, -60.f}, {-425.f, -760.f},
+    {-425.f, -760.f}, {-495.f, -828.f},
+
+    // Upper Right
+    {495.f, -828.f}, {425.f, -760.f},
+    {425.f, -760.f}, {425.f, -60.f},
+    {425.f, -60.f}, {460.f, -47.f},
+
+    // Lower Right
+    {460.f, 47.f}, {425.f, 60.f},
+    {425.f, 60.f}, {425.f, 760.f},
+    {425.f, 760.f}, {495.f, 828.f}
+};
+const int triangle_ordering[15] = {
+        1,
+      0,  1,
+    1,  8,  0,
+  0,  1,  0,  1,
+1,  0,  0,  1,  0
+};
+
+// World
+
+void PhysicsWorld::set_all_moving() {
+    for(auto &flag : balls.flags) {
+        if(!(flag & BALL_POCKETED)) flag |= BALL_MOVING;
+    }
+}
+
+void PhysicsWorld::wake(size_t i) {
+    if(!balls.is_pocketed(i)) balls.flags[i] |= BALL_MOVING;
+}
+
+bool PhysicsWorld::none_moving() const {
+    return !any_moving(&balls);
+}
+
+void PhysicsWorld::collect_active() {
+    active.clear();
+    for(uint32_t i = 0; i < balls.size(); i++) {
+        if(balls.flags[i] & BALL_MOVING) active.push_back(i);
+    }
+}
+
+void PhysicsWorld::sub_update(float dt) {
+    collect_active();
+    // A full pass leaves sleeping balls untouched, so it is only a
+    // question of which is cheaper
+    if(active.size()*4 < balls.size()) {
+        integrate(&balls, active, dt);
+    }
+    else {
+        integrate(&balls, dt);
+    }
+}
+
+// Pairs with at least one ball awake, in the same sorted order the broad
+// phases give. Few awake balls test themselves against every ball, many
+// go through the broad phase and drop the sleeping pairs.
+void PhysicsWorld::find_active_pairs() {
+    if(active.size()*8 >= balls.size()) {
+        broad_phase->find_pairs(&balls, &pairs);
+        pairs.erase(remove_if(pairs.begin(), pairs.end(), [this](const BallPair &pair) {
+            return !balls.is_moving(pair.i) && !balls.is_moving(pair.j);
+        }), pairs.end());
+        return;
+    }
+
+    pairs.clear();
+    for(uint32_t a : active) {
+        if(!balls.is_moving(a)) continue;
+        float reach_a = balls.radius[a];
+        for(uint32_t b = 0; b < balls.size(); b++) {
+            // Two awake balls are listed once, from the higher index
+            if(b == a || (b > a && balls.is_moving(b))) continue;
+            float reach = reach_a + balls.radius[b];
+            if(fabsf(balls.x[a] - balls.x[b]) > reach || fabsf(balls.y[a] - balls.y[b]) > reach) continue;
+            pairs.push_back(a > b ? BallPair{a, b} : BallPair{b, a});
+        }
+    }
+    sort(pairs.begin(), pairs.end(), [](const BallPair &p, const BallPair &q) {
+        return p.i != q.i ? p.i < q.i : p.j < q.j;
+    });
+}
+
+// A sleeping ball that was hit wakes if the hit was hard enough, anything
+// slower would stop on the next integration anyway
+void PhysicsWorld::settle_contact(size_t i) {
+    if(balls.is_moving(i)) return;
+    Vector2<float> velocity = balls.velocity(i);
+    if(magnitude_squared(velocity) >= moving_threshold*moving_threshold) {
+        balls.flags[i] |= BALL_MOVING;
+    }
+    else {
+        balls.set_velocity(i, {0.f, 0.f});
+    }
+}
+
+void PhysicsWorld::rebuild_cushions() {
+    float max_radius = 0.f;
+    for(float r : balls.radius) {
+        max_radius = max(max_radius, r);
+    }
+    cushions.build(lines, max_radius);
+}
+
+void PhysicsWorld::check_ball_line_collision() {
+    long hits = 0;
+    for(size_t i = 0; i < balls.size(); i++) {
+        // Sleeping balls have no velocity to reflect
+        if(!balls.is_moving(i)) continue;
+        if(balls.radius[i] > cushions.built_radius) rebuild_cushions();
+
+        cushions.query(balls.position(i), balls.radius[i], [&](uint32_t l) {
+            balls.set_velocity(i, reflect(balls.velocity(i), lines[l].normal));
+            hits++;
+        });
+    }
+    profile_count(COUNTER_CUSHION_HITS, hits);
+}
+
+bool PhysicsWorld::resolve_ball_pair(size_t i, size_t j) {
+    if(balls.is_pocketed(i) || balls.is_pocketed(j)) return false;
+
+    Vector2<float> position_i = balls.position(i);
+    Vector2<float> position_j = balls.position(j);
+    Vector2<float> velocity_i = balls.velocity(i);
+    Vector2<float> velocity_j = balls.velocity(j);
+
+    if(!collide_balls(&position_i, &velocity_i, balls.mass[i], balls.radius[i],
+                      &position_j, &velocity_j, balls.mass[j], balls.radius[j])) return false;
+
+    balls.set_velocity(i, velocity_i);
+    balls.set_velocity(j, velocity_j);
+    balls.set_position(i, position_i);
+    balls.set_position(j, position_j);
+    settle_contact(i);
+    settle_contact(j);
+    return true;
+}
+
+void PhysicsWorld::ball_to_ball_collision() {
+    find_active_pairs();
+    long contacts = 0;
+    if(contact_mode == COLORED_CONTACTS) {
+        contacts = contact_solver.solve(&balls, pairs, contact_pool);
+        for(auto &contact : contact_solver.contacts()) {
+            settle_contact(contact.i);
+            settle_contact(contact.j);
+        }
+    }
+    else {
+        for(auto &pair : pairs) {
+            contacts += resolve_ball_pair(pair.i, pair.j);
+        }
+    }
+    profile_count(COUNTER_COLLISIONS, contacts);
+}
+
+void PhysicsWorld::check_ball_pocket_collision() {
+    for(size_t i = 0; i < balls.size(); i++) {
+        if(!balls.is_moving(i)) continue;
+
+        for(size_t p = 0; p < pockets.size(); p++) {
+            Vector2<float> gap = balls.position(i) - pockets[p];
+            if(dot(gap, gap) <= pocket_radius*pocket_radius) {
+                // Parked in the pocket and left out of every other test
+                balls.set_position(i, pockets[p]);
+                balls.set_velocity(i, {0.f, 0.f});
+                balls.flags[i] = BALL_POCKETED;
+                balls.pocket[i] = p;
+                break;
+            }
+        }
+    }
+}
+
+void PhysicsWorld::respot_ball(size_t i, Vector2<float> position) {
+    balls.set_position(i, position);
+    balls.set_velocity(i, {0.f, 0.f});
+    balls.flags[i] = 0;
+    balls.pocket[i] = -1;
+}
+
+uint64_t PhysicsWorld::state_hash() const {
+    // FNV-1a over the raw bits, equal hashes mean bitwise equal balls
+    uint64_t hash = 14695981039346656037ull;
+    auto mix = [&hash](const void *data, size_t bytes) {
+        const unsigned char *p = (const unsigned char*)data;
+        for(size_t i = 0; i < bytes; i++) {
+            hash = (hash ^ p[i])*1099511628211ull;
+        }
+    };
+    mix(balls.x.data(), balls.size()*sizeof(float));
+    mix(balls.y.data(), balls.size()*sizeof(float));
+    mix(balls.vx.data(), balls.size()*sizeof(float));
+    mix(balls.vy.data(), balls.size()*sizeof(float));
+    mix(balls.flags.data(), balls.size()*sizeof(uint32_t));
+    mix(balls.pocket.data(), balls.size()*sizeof(int8_t));
+    return hash;
+}
+
+int PhysicsWorld::sub_steps(float dt) const {
+    if(sub_step_mode == FIXED_SUB_STEPS) return sub_updates;
+
+    // Speeds only drop between contacts, so the fastest ball now bounds
+    // the travel of every ball over the tick
+    float fastest_squared = 0.f;
+    for(size_t i = 0; i < balls.size(); i++) {
+        if(balls.is_moving(i)) fastest_squared = max(fastest_squared, magnitude_squared(balls.velocity(i)));
+    }
+    float steps = ceilf(sqrtf(fastest_squared)*dt/max_sub_step_travel);
+    return steps < max_sub_updates ? max(1, (int)steps) : max_sub_updates;
+}
+
+void PhysicsWorld::update(float dt) {
+    if(none_moving()) return;
+    int steps = sub_steps(dt);
+    float sub_dt = dt / steps;
+    for(int i = 0; i < steps; i++) {
+        {
+            PROFILE_SCOPE("sub_update");
+            sub_update(sub_dt);
+        }
+        {
+            PROFILE_SCOPE("ball_to_ball_collision");
+            ball_to_ball_collision();
+        }
+        {
+            PROFILE_SCOPE("check_ball_line_collision");
+            check_ball_line_collision();
+        }
+        {
+            PROFILE_SCOPE("check_ball_pocket_collision");
+            check_ball_pocket_collision();
+        }
+    }
+    profile_count(COUNTER_SUB_STEPS, steps);
+}
+
+// Standard table setup
+
+void generate_all_balls(PhysicsWorld *world) {
+    world->balls.clear();
+    // White ball, solids, black 8 ball and stripes, numbered 0 to 15
+    for(int i = 0; i <= 15; i++) {
+        world->balls.push_back(Ball(0.f, 0.f, ball_size, ball_mass, friction, i));
+    }
+}
+
+void generate_all_lines(PhysicsWorld *world, float scale) {
+    world->lines.clear();
+    for(size_t i = 0; i < size(line_points); i += 2) {
+        world->lines.push_back(Line(line_points[i]*scale, line_points[i+1]*scale));
+    }
+    world->rebuild_cushions();
+}
+
+void generate_all_pockets(PhysicsWorld *world, Vector2<float> corner_hole, Vector2<float> side_hole, float hole_r) {
+    world->pocket_radius = hole_r;
+    world->pockets.clear();
+
+    world->pockets.push_back(corner_hole);
+    world->pockets.push_back(corner_hole*Vector2<float>{-1.f, 1.f});
+    world->pockets.push_back(corner_hole*Vector2<float>{1.f, -1.f});
+    world->pockets.push_back(corner_hole*Vector2<float>{-1.f, -1.f});
+
+    world->pockets.push_back(side_hole);
+    world->pockets.push_back(side_hole*Vector2<float>{-1.f, 1.f});
+}
+
+//Creation of Ball Triangle Positioning
+void triangle(float x, float y, PhysicsWorld *world, unsigned seed) {
+    int index = 0;
+    float ball_spacing_x = ball_size;
+    float ball_spacing_y = -sinf(PI*2/3)*ball_size*2;
+
+    mt19937 rng(seed); //Same seed, same rack
+
+    // Fixed arrays, racking never touches the heap
+    int solid[] = {1, 2, 3, 4, 5, 6, 7};
+    shuffle(begin(solid), end(solid), rng);
+    int striped[] = {9, 10, 11, 12, 13, 14, 15};
+    shuffle(begin(striped), end(striped), rng);
+    int solids_left = size(solid), stripes_left = size(striped);
+
+    int shuffledNumbers[size(triangle_ordering)];
+    for(size_t k = 0; k < size(triangle_ordering); k++) {
+        switch(triangle_ordering[k]) {
+            case 0: {
+                shuffledNumbers[k] = solid[--solids_left];
+                break;
+            }
+            case 1: {
+                shuffledNumbers[k] = striped[--stripes_left];
+                break;
+            }
+            default: {
+                shuffledNumbers[k] = 8;
+                break;
+            }
+        }
+    }
+
+    float x_cur = x - 5*ball_size;
+    float y_cur = y;
+
+    for(int i = 1; i <= 5; i++) {
+        for(int k = 5 - i; k > 0; k--) {
+            x_cur += ball_spacing_x; //Create spacing
+        }
+        for(int j = 1; j <= i; j++) {
+            x_cur += ball_spacing_x;
+            world->balls.set_position(shuffledNumbers[index], {x_cur, y_cur}); //Based on spacing position ball into location
+            x_cur += ball_spacing_x;
+            index++;
+        }
+
+        y_cur += ball_spacing_y;
+        x_cur = x - 5*ball_size;
+    }
+}
+
+void setup_standard_table(PhysicsWorld *world, unsigned seed) {
+    generate_all_pockets(world, {423.5f, -834.5f}, {475.f, 0.f}, ball_size*2);
+    // Balls first, the cushion grid is built for their radius
+    world->rack(seed);
+    generate_all_lines(world);
+}
+
+void PhysicsWorld::rack(unsigned seed) {
+    generate_all_balls(this);
+    triangle(0, -422, this, seed);
+    balls.set_position(0, {0, line_distance});
+}
+
+// Stress mode
+
+// Inside edge of the cushions on the unscaled table
+const Vector2<float> play_area = {425.f, 838.f};
+
+float stress_table_scale(int ball_count) {
+    // Keep roughly a third of the cloth covered
+    float footprint = 2.2f*ball_size*2.2f*ball_size;
+    float area = 4*play_area.x*play_area.y;
+    return max(1.f, sqrtf(ball_count*footprint*3/area));
+}
+
+void generate_stress_field(PhysicsWorld *world, int ball_count, float scale, unsigned seed) {
+    mt19937 rng(seed);
+    uniform_real_distribution<float> jitter(-0.1f*ball_size, 0.1f*ball_size);
+    uniform_real_distribution<float> speed(-400.f, 400.f);
+
+    // Fill a grid inside the cushions, row by row
+    float spacing = 2.2f*ball_size;
+    Vector2<float> corner = play_area*scale*-1 + spacing;
+    int columns = max(1, (int)((play_area.x*scale*2 - 2*spacing)/spacing));
+
+    world->balls.clear();
+    for(int i = 0; i < ball_count; i++) {
+        float x = corner.x + (i % columns)*spacing + jitter(rng);
+        float y = corner.y + (i / columns)*spacing + jitter(rng);
+        Ball ball(x, y, ball_size, ball_mass, friction, i);
+        ball.velocity = {speed(rng), speed(rng)};
+        ball.is_moving = true;
+        world->balls.push_back(ball);
+    }
+
+    // Balls first, the cushion grid is built for their radius
+    generate_all_pockets(world, Vector2<float>{423.5f, -834.5f}*scale, Vector2<float>{475.f, 0.f}*scale, ball_size*2);
+    generate_all_lines(world, scale);
+    world->set_broad_phase(choose_broad_phase(ball_count));
+}
+
+float generate_synthetic_table(PhysicsWorld *world, const SyntheticSpec &spec) {
+    mt19937 rng(spec.seed);
+    uniform_real_distribution<float> speed(-spec.max_speed, spec.max_speed);
+    uniform_real_distribution<float> radius(spec.min_radius, spec.max_radius);
+    uniform_real_distribution<float> mass(spec.min_mass, spec.max_mass);
+
+    // Grid cells sized for the largest ball, grown until every ball has one
+    float spacing = 2.2f*spec.max_radius;
+    float scale = max(spec.scale, .1f);
+    auto cells = [&](float s, int *columns) {
+        *columns = max(1, (int)((play_area.x*s*2 - 2*spacing)/spacing));
+        int rows = max(0, (int)((play_area.y*s*2 - 2*spacing)/spacing));
+        return (long)*columns*rows;
+    };
+    int columns;
+    while(cells(scale, &columns) < spec.ball_count) {
+        scale *= 1.05f;
+    }
+
+    world->balls.clear();
+    Vector2<float> corner = play_area*scale*-1 + spacing;
+    for(int i = 0; i < spec.ball_count; i++) {
+        float x = corner.x + (i % columns)*spacing;
+        float y = corner.y + (i / columns)*spacing;
+        Ball ball(x, y, radius(rng), mass(rng), friction, i);
+        ball.velocity = {speed(rng), speed(rng)};
+        ball.is_moving = spec.max_speed > 0;
+        world->balls.push_back(ball);
+    }
+    generate_all_pockets(world, Vector2<float>{423.5f, -834.5f}*scale, Vector2<float>{475.f, 0.f}*scale,
+                         max((float)ball_size, spec.max_radius)*2);
+    generate_all_lines(world, scale);
+    world->set_broad_phase(choose_broad_phase(spec.ball_count));
+    return scale;
+}
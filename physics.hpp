@@ -0,0 +1,208 @@
+#include <vector>
+#include "vector_functions.hpp"
+#include "ball_store.hpp"
+#include "broad_phase.hpp"
+#include "cushion_grid.hpp"
+#include "contact_solver.hpp"
+
+#pragma once
+
+using namespace std;
+
+// Physics constants
+
+const int sub_updates = 8;
+
+const int ball_size = 25;
+const int ball_mass = 100;
+const float friction = 1.f;
+const float line_distance = 422;
+
+// How many sub-steps update(dt) splits a tick into. Fixed always runs
+// sub_updates and is what TableBatch, PrecisionWorld and the recorded
+// hashes match. Adaptive runs just enough that the fastest ball moves at
+// most max_sub_step_travel per sub-step, capped at max_sub_updates.
+enum sub_step_type {
+    FIXED_SUB_STEPS,
+    ADAPTIVE_SUB_STEPS
+};
+const float max_sub_step_travel = ball_size/4.f;
+const int max_sub_updates = 32;
+
+// How ball_to_ball_collision resolves the contacts it finds. Sequential
+// resolves each pair on the spot in pair order and is what TableBatch,
+// PrecisionWorld and the recorded hashes match. Colored hands every
+// contact of the sub-step to ContactSolver.
+enum contact_solver_type {
+    SEQUENTIAL_CONTACTS,
+    COLORED_CONTACTS
+};
+
+// Cushion segment, plain data with no rendering members
+
+class Line {
+    public:
+    Vector2<float> p1, p2, normal;
+    float length;
+
+    Line(Vector2<float> point1, Vector2<float> point2) {
+        p1 = point1;
+        p2 = point2;
+        normal = unit(Vector2<float>{-(p2.y - p1.y), p2.x - p1.x});
+        length = distance(p1, p2);
+    }
+
+    // https://www.youtube.com/watch?v=h1WXaa2UwLQ
+    bool collision(Vector2<float> pos, float radius) const {
+        float dot_product = dot(pos - p1, p2 - p1) / (length*length);
+        Vector2<float> closest = p1 + (p2-p1)*dot_product;
+
+        if(distance(pos, p1) <= radius || distance(pos, p2) <= radius) return true;
+        if(distance(closest, p1) + distance(closest, p2) - 1 > length) return false;
+        if(distance(pos, closest) <= radius) return true;
+        return false;
+    }
+};
+
+// Everything needed to step a table: balls, cushions and pockets. The
+// SFML front end in classes.hpp draws these, the physics never needs a
+// window. Balls are indexed by their number, so ball 0 is the cue ball.
+
+// Balls without BALL_MOVING are asleep: they are not integrated, not
+// tested against cushions or pockets, and a pair is only tested when one
+// of its balls is awake. A sleeping ball wakes when a contact leaves it
+// above moving_threshold, so a shot only has to wake the cue ball.
+
+class PhysicsWorld {
+    private:
+    vector<BallPair>       pairs;
+    // Awake balls, gathered at the start of each sub-step
+    vector<uint32_t>       active;
+
+    void collect_active();
+    void find_active_pairs();
+    void settle_contact(size_t i);
+
+    public:
+    BallStore              balls;
+    vector<Line>           lines;
+    vector<Vector2<float>> pockets;
+    float                  pocket_radius;
+    unique_ptr<BroadPhase> broad_phase;
+    CushionGrid            cushions;
+    sub_step_type          sub_step_mode;
+    contact_solver_type    contact_mode;
+    ContactSolver          contact_solver;
+    // Splits large contact colours over its threads when set, not owned
+    ThreadPool            *contact_pool;
+
+    PhysicsWorld() {
+        pocket_radius = 0;
+        broad_phase = make_broad_phase(BRUTE_FORCE);
+        sub_step_mode = FIXED_SUB_STEPS;
+        contact_mode = SEQUENTIAL_CONTACTS;
+        contact_pool = nullptr;
+    }
+
+    PhysicsWorld(const PhysicsWorld &other) {
+        *this = other;
+    }
+
+    // Every member copies into the capacity it already has, so cloning a
+    // table into a world that held one like it allocates nothing. The
+    // broad phase only keeps scratch between calls and is reused as long
+    // as it is the same kind.
+    PhysicsWorld &operator=(const PhysicsWorld &other) {
+        if(this == &other) return *this;
+        balls = other.balls;
+        lines = other.lines;
+        pockets = other.pockets;
+        pocket_radius = other.pocket_radius;
+        if(!broad_phase || broad_phase->type() != other.broad_phase->type()) {
+            broad_phase = other.broad_phase->clone();
+        }
+        cushions = other.cushions;
+        sub_step_mode = other.sub_step_mode;
+        contact_mode = other.contact_mode;
+        contact_pool = other.contact_pool;
+        contact_solver.velocity_iterations = other.contact_solver.velocity_iterations;
+        contact_solver.position_iterations = other.contact_solver.position_iterations;
+        contact_solver.restitution = other.contact_solver.restitution;
+        contact_solver.parallel_threshold = other.contact_solver.parallel_threshold;
+        return *this;
+    }
+
+    void set_broad_phase(broad_phase_type type) {
+        broad_phase = make_broad_phase(type);
+    }
+
+    // Call after changing lines, balls bigger than the grid was built
+    // for also trigger a rebuild
+    void rebuild_cushions();
+
+    void set_all_moving();
+    // Wakes one ball, e.g. the cue ball after setting its velocity
+    void wake(size_t i);
+    bool none_moving() const;
+
+    void sub_update(float dt);
+    bool resolve_ball_pair(size_t i, size_t j);
+    void ball_to_ball_collision();
+    void check_ball_line_collision();
+    void check_ball_pocket_collision();
+    // Sub-steps update(dt) would run now, at least 1
+    int sub_steps(float dt) const;
+    // Does nothing while every ball rests
+    void update(float dt);
+
+    // Put a ball back on the table at rest, e.g. the cue ball after a scratch
+    void respot_ball(size_t i, Vector2<float> position);
+
+    // Fresh standard rack on the table already set up, in place
+    void rack(unsigned seed);
+
+    // Same start state and same dt sequence give the same hash on one build
+    uint64_t state_hash() const;
+
+    // Everything update() changes is in the ball arena, the rest is the
+    // table or scratch rebuilt every sub-step, so saving and restoring
+    // the world is one block copy. Only restore a block saved from this
+    // table, e.g. for rollback.
+    size_t state_size() const {
+        return balls.state_size();
+    }
+    void save_state(uint8_t *to) const {
+        balls.save_state(to);
+    }
+    void restore_state(const uint8_t *from) {
+        balls.restore_state(from);
+    }
+};
+
+// Standard table setup
+
+void generate_all_balls(PhysicsWorld *world);
+void generate_all_lines(PhysicsWorld *world, float scale = 1.f);
+void generate_all_pockets(PhysicsWorld *world, Vector2<float> corner_hole, Vector2<float> side_hole, float hole_r);
+void triangle(float x, float y, PhysicsWorld *world, unsigned seed);
+void setup_standard_table(PhysicsWorld *world, unsigned seed);
+
+// Stress mode: the standard table scaled up and filled with moving balls
+
+float stress_table_scale(int ball_count);
+void generate_stress_field(PhysicsWorld *world, int ball_count, float scale, unsigned seed);
+
+// Synthetic tables for scaling runs: the standard cushions and pockets
+// scaled up, and a grid of balls of mixed sizes and masses moving in
+// random directions. The scale grows if the balls would not fit, the
+// one used is returned.
+struct SyntheticSpec {
+    float    scale;
+    int      ball_count;
+    unsigned seed;
+    float    max_speed;
+    float    min_radius, max_radius;
+    float    min_mass, max_mass;
+};
+
+float generate_synthetic_table(PhysicsWorld *world, const SyntheticSpec &spec);
@@ -0,0 +1,62 @@
+#include "vector_functions.hpp"
+
+#pragma once
+
+using namespace std;
+
+// Per-ball and per-pair physics, templated on the scalar type so the game
+// (float) and the reference and deterministic runs (double, Fixed) share
+// one implementation. Each instantiation is plain arithmetic in its own
+// type, with no conversions or pow() calls.
+
+// One friction step, same operation order as the BallStore kernels.
+// Returns false when a moving ball drops under the threshold and stops.
+template<class S>
+inline bool integrate_ball(Vector2<S> *position, Vector2<S> *velocity, S friction, S dt, S threshold_squared) {
+    Vector2<S> acceleration = *velocity*friction*S(-1);
+    *position = *position + *velocity*dt + acceleration*dt*dt/S(2);
+    *velocity = *velocity + acceleration*dt;
+    return magnitude_squared(*velocity) >= threshold_squared;
+}
+
+// Elastic bounce and overlap push-out for two balls. Balls that do not
+// touch are rejected on squared distances, only contacts take a root.
+template<class S>
+inline bool collide_balls(Vector2<S> *position_i, Vector2<S> *velocity_i, S mass_i, S radius_i,
+                          Vector2<S> *position_j, Vector2<S> *velocity_j, S mass_j, S radius_j) {
+    Vector2<S> gap = *position_i - *position_j;
+    S reach = radius_i + radius_j;
+    S gap_squared = magnitude_squared(gap);
+    if(gap_squared > reach*reach) return false;
+
+    S gap_length = scalar_sqrt(gap_squared);
+    S overshot = gap_length - reach;
+    Vector2<S> normal = gap_length == S(0) ? Vector2<S>{S(0), S(0)} : gap/gap_length;
+
+    // Split each velocity along the normal and swap the normal parts
+    S dot_i = dot(*velocity_i, normal);
+    Vector2<S> velocity_xi = normal*dot_i;
+    Vector2<S> velocity_yi = *velocity_i - velocity_xi;
+    S dot_j = dot(*velocity_j, normal);
+    Vector2<S> velocity_xj = normal*dot_j;
+    Vector2<S> velocity_yj = *velocity_j - velocity_xj;
+
+    S total = mass_i + mass_j;
+    *velocity_i = (velocity_xi*((mass_i - mass_j)/total)) + (velocity_xj*((S(2)*mass_j)/total)) + velocity_yi;
+    *velocity_j = (velocity_xi*((S(2)*mass_i)/total)) + (velocity_xj*((mass_j - mass_i)/total)) + velocity_yj;
+
+    Vector2<S> correction_overlap = normal*overshot;
+    *position_i = *position_i - correction_overlap;
+    *position_j = *position_j + correction_overlap;
+    return true;
+}
+
+// Whether a ball overlaps the segment from p1 along direction
+template<class S>
+inline bool touches_segment(Vector2<S> position, S radius, Vector2<S> p1, Vector2<S> direction, S inverse_length_squared) {
+    Vector2<S> offset = position - p1;
+    S t = dot(offset, direction)*inverse_length_squared;
+    t = t < S(0) ? S(0) : (t > S(1) ? S(1) : t);
+    Vector2<S> gap = offset - direction*t;
+    return magnitude_squared(gap) <= radius*radius;
+}
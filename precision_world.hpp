@@ -0,0 +1,178 @@
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include "physics.hpp"
+#include "physics_kernels.hpp"
+#include "precision.hpp"
+
+#pragma once
+
+using namespace std;
+
+// The PhysicsWorld sub-step loop instantiated for another scalar type:
+// PrecisionWorld<double> for reference runs, PrecisionWorld<Fixed> for
+// results that match bit for bit across machines and compilers. It is
+// built from a PhysicsWorld and follows the same step order with the
+// same kernels, but without the float-only SIMD integration and broad
+// phase, so it suits checking and replaying shots rather than stress mode.
+
+template<class S>
+class PrecisionWorld {
+    private:
+    struct Cushion {
+        Vector2<S> p1, direction, normal;
+        S inverse_length_squared;
+    };
+
+    public:
+    vector<Vector2<S>> position, velocity;
+    vector<S>          friction, radius, mass;
+    vector<uint32_t>   flags;
+    vector<int8_t>     pocket;
+    vector<Cushion>    cushions;
+    vector<Vector2<S>> pockets;
+    S                  pocket_radius;
+    vector<BallPair>   pairs;
+
+    PrecisionWorld(const PhysicsWorld &world) {
+        const BallStore &balls = world.balls;
+        for(size_t i = 0; i < balls.size(); i++) {
+            position.push_back({S(balls.x[i]), S(balls.y[i])});
+            velocity.push_back({S(balls.vx[i]), S(balls.vy[i])});
+            friction.push_back(S(balls.friction[i]));
+            radius.push_back(S(balls.radius[i]));
+            mass.push_back(S(balls.mass[i]));
+        }
+        flags.assign(balls.flags.begin(), balls.flags.end());
+        pocket.assign(balls.pocket.begin(), balls.pocket.end());
+
+        for(auto &line : world.lines) {
+            Cushion cushion;
+            cushion.p1 = {S(line.p1.x), S(line.p1.y)};
+            cushion.direction = Vector2<S>{S(line.p2.x), S(line.p2.y)} - cushion.p1;
+            cushion.normal = {S(line.normal.x), S(line.normal.y)};
+            // Too short for S to measure, and Fixed would divide by zero
+            S length_squared = magnitude_squared(cushion.direction);
+            if(length_squared == S(0)) continue;
+            cushion.inverse_length_squared = S(1)/length_squared;
+            cushions.push_back(cushion);
+        }
+        for(auto &p : world.pockets) {
+            pockets.push_back({S(p.x), S(p.y)});
+        }
+        pocket_radius = S(world.pocket_radius);
+    }
+
+    size_t size() const {
+        return position.size();
+    }
+
+    bool is_pocketed(size_t i) const {
+        return flags[i] & BALL_POCKETED;
+    }
+
+    bool none_moving() const {
+        for(uint32_t flag : flags) {
+            if(flag & BALL_MOVING) return false;
+        }
+        return true;
+    }
+
+    Vector2<float> float_position(size_t i) const {
+        return {(float)position[i].x, (float)position[i].y};
+    }
+
+    void sub_update(S dt) {
+        const S threshold_squared = S(moving_threshold*moving_threshold);
+        for(size_t i = 0; i < size(); i++) {
+            if(!integrate_ball(&position[i], &velocity[i], friction[i], dt, threshold_squared) && (flags[i] & BALL_MOVING)) {
+                velocity[i] = {S(0), S(0)};
+                flags[i] &= ~BALL_MOVING;
+            }
+        }
+    }
+
+    // Same candidates as PhysicsWorld, pairs with a ball awake, all found
+    // before any is resolved so contacts resolve in the same order
+    void ball_to_ball_collision() {
+        pairs.clear();
+        for(uint32_t i = 0; i < size(); i++) {
+            for(uint32_t j = 0; j < i; j++) {
+                if(!(flags[i] & BALL_MOVING) && !(flags[j] & BALL_MOVING)) continue;
+                S reach = radius[i] + radius[j];
+                Vector2<S> gap = position[i] - position[j];
+                if(gap.x <= reach && -gap.x <= reach && gap.y <= reach && -gap.y <= reach) pairs.push_back({i, j});
+            }
+        }
+        for(auto &pair : pairs) {
+            size_t i = pair.i, j = pair.j;
+            if(is_pocketed(i) || is_pocketed(j)) continue;
+            if(collide_balls(&position[i], &velocity[i], mass[i], radius[i],
+                             &position[j], &velocity[j], mass[j], radius[j])) {
+                settle_contact(i);
+                settle_contact(j);
+            }
+        }
+    }
+
+    void settle_contact(size_t i) {
+        if(flags[i] & BALL_MOVING) return;
+        if(magnitude_squared(velocity[i]) >= S(moving_threshold*moving_threshold)) {
+            flags[i] |= BALL_MOVING;
+        }
+        else {
+            velocity[i] = {S(0), S(0)};
+        }
+    }
+
+    void check_ball_line_collision() {
+        for(size_t i = 0; i < size(); i++) {
+            if(!(flags[i] & BALL_MOVING)) continue;
+            for(auto &cushion : cushions) {
+                if(touches_segment(position[i], radius[i], cushion.p1, cushion.direction, cushion.inverse_length_squared)) {
+                    velocity[i] = reflect(velocity[i], cushion.normal);
+                }
+            }
+        }
+    }
+
+    void check_ball_pocket_collision() {
+        for(size_t i = 0; i < size(); i++) {
+            if(!(flags[i] & BALL_MOVING)) continue;
+            for(size_t p = 0; p < pockets.size(); p++) {
+                if(distance_squared(position[i], pockets[p]) <= pocket_radius*pocket_radius) {
+                    position[i] = pockets[p];
+                    velocity[i] = {S(0), S(0)};
+                    flags[i] = BALL_POCKETED;
+                    pocket[i] = p;
+                    break;
+                }
+            }
+        }
+    }
+
+    void update(float dt) {
+        S sub_dt = S(dt)/S(sub_updates);
+        for(int i = 0; i < sub_updates; i++) {
+            sub_update(sub_dt);
+            ball_to_ball_collision();
+            check_ball_line_collision();
+            check_ball_pocket_collision();
+        }
+    }
+
+    // FNV-1a over the raw values, for Fixed equal on every machine
+    uint64_t state_hash() const {
+        uint64_t hash = 14695981039346656037ull;
+        auto mix = [&hash](const void *data, size_t bytes) {
+            const uint8_t *p = (const uint8_t *)data;
+            for(size_t k = 0; k < bytes; k++) {
+                hash = (hash ^ p[k])*1099511628211ull;
+            }
+        };
+        mix(position.data(), position.size()*sizeof(Vector2<S>));
+        mix(velocity.data(), velocity.size()*sizeof(Vector2<S>));
+        mix(flags.data(), flags.size()*sizeof(uint32_t));
+        return hash;
+    }
+};
@@ -0,0 +1,137 @@
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include "profiler.hpp"
+
+using namespace std;
+
+const char *const profile_counter_names[COUNTER_COUNT] = {
+    "collisions",
+    "cushion_hits",
+    "sub_steps"
+};
+
+static thread_local Profiler *thread_profiler = nullptr;
+
+Profiler *get_profiler() {
+    return thread_profiler;
+}
+
+void set_profiler(Profiler *profiler) {
+    thread_profiler = profiler;
+}
+
+// First use of any profiler, shared so every thread's timestamps agree
+static chrono::steady_clock::time_point shared_epoch() {
+    static const chrono::steady_clock::time_point epoch = chrono::steady_clock::now();
+    return epoch;
+}
+
+Profiler::Profiler(size_t frames_kept) {
+    epoch = shared_epoch();
+    max_frames = max((size_t)1, frames_kept);
+    in_frame = false;
+}
+
+void Profiler::begin_frame() {
+    current.samples.clear();
+    fill(begin(current.counters), end(current.counters), 0);
+    current.start_ns = now_ns();
+    in_frame = true;
+}
+
+void Profiler::end_frame() {
+    if(!in_frame) return;
+    in_frame = false;
+    current.duration_ns = now_ns() - current.start_ns;
+
+    if(frames.size() >= max_frames) frames.pop_front();
+    frames.push_back(current);
+}
+
+void Profiler::merge(const ProfileFrame &frame, const char *frame_name, int tid) {
+    if(!in_frame) return;
+    current.samples.push_back({frame_name, frame.start_ns, frame.duration_ns, tid});
+    for(auto &sample : frame.samples) {
+        current.samples.push_back({sample.name, sample.start_ns, sample.duration_ns, tid});
+    }
+    for(int c = 0; c < COUNTER_COUNT; c++) {
+        current.counters[c] += frame.counters[c];
+    }
+}
+
+vector<ProfileTotal> Profiler::totals(size_t last) const {
+    vector<ProfileTotal> result;
+    size_t n = min(last, frames.size());
+    if(n == 0) return result;
+
+    for(size_t f = frames.size() - n; f < frames.size(); f++) {
+        for(auto &sample : frames[f].samples) {
+            // By text, the same literal in two files need not share an address
+            auto it = find_if(result.begin(), result.end(), [&](const ProfileTotal &t) { return strcmp(t.name, sample.name) == 0; });
+            if(it == result.end()) {
+                result.push_back({sample.name, 0.0, 0.0});
+                it = result.end() - 1;
+            }
+            it->ms_per_frame += sample.duration_ns/1e6;
+            it->calls_per_frame += 1;
+        }
+    }
+    for(auto &total : result) {
+        total.ms_per_frame /= n;
+        total.calls_per_frame /= n;
+    }
+    return result;
+}
+
+double Profiler::average_counter(profile_counter counter, size_t last) const {
+    size_t n = min(last, frames.size());
+    if(n == 0) return 0;
+    double sum = 0;
+    for(size_t f = frames.size() - n; f < frames.size(); f++) {
+        sum += frames[f].counters[counter];
+    }
+    return sum/n;
+}
+
+double Profiler::average_frame_ms(size_t last) const {
+    size_t n = min(last, frames.size());
+    if(n == 0) return 0;
+    double sum = 0;
+    for(size_t f = frames.size() - n; f < frames.size(); f++) {
+        sum += frames[f].duration_ns/1e6;
+    }
+    return sum/n;
+}
+
+bool Profiler::write_chrome_trace(const string &path) const {
+    FILE *file = fopen(path.c_str(), "w");
+    if(!file) return false;
+
+    // Timestamps in the trace format are microseconds
+    fprintf(file, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+    bool first = true;
+    auto separator = [&]() {
+        fprintf(file, first ? "  " : ",\n  ");
+        first = false;
+    };
+
+    for(auto &frame : frames) {
+        separator();
+        fprintf(file, "{\"name\": \"frame\", \"ph\": \"X\", \"pid\": 1, \"tid\": 1, \"ts\": %.3f, \"dur\": %.3f}",
+            frame.start_ns/1e3, frame.duration_ns/1e3);
+        for(auto &sample : frame.samples) {
+            separator();
+            fprintf(file, "{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %d, \"ts\": %.3f, \"dur\": %.3f}",
+                sample.name, sample.tid, sample.start_ns/1e3, sample.duration_ns/1e3);
+        }
+        for(int c = 0; c < COUNTER_COUNT; c++) {
+            separator();
+            fprintf(file, "{\"name\": \"%s\", \"ph\": \"C\", \"pid\": 1, \"ts\": %.3f, \"args\": {\"count\": %ld}}",
+                profile_counter_names[c], frame.start_ns/1e3, frame.counters[c]);
+        }
+    }
+    fprintf(file, "\n]}\n");
+    fclose(file);
+    return true;
+}
@@ -0,0 +1,120 @@
+#include <vector>
+#include <deque>
+#include <string>
+#include <chrono>
+#include <cstdint>
+
+#pragma once
+
+using namespace std;
+
+// Frame profiler. Scopes record where each frame went, counters record
+// how much work it did, and the last max_frames frames are kept so a
+// spike can be looked at after the fact, on screen or in chrome://tracing.
+//
+// Instrumented code only pays for a null check unless the thread has a
+// profiler installed with set_profiler(), so worker threads running
+// simulate_shot() never touch it. A thread with its own profiler hands
+// its frames to the render thread's one with merge(). Every profiler
+// counts from the same epoch, so their timestamps line up.
+
+enum profile_counter {
+    COUNTER_COLLISIONS,
+    COUNTER_CUSHION_HITS,
+    COUNTER_SUB_STEPS,
+    COUNTER_COUNT
+};
+
+extern const char *const profile_counter_names[COUNTER_COUNT];
+
+struct ProfileSample {
+    const char *name;
+    uint64_t    start_ns;
+    uint64_t    duration_ns;
+    // Trace row, 1 for the thread the frames are on
+    int         tid;
+};
+
+struct ProfileFrame {
+    uint64_t              start_ns;
+    uint64_t              duration_ns;
+    vector<ProfileSample> samples;
+    long                  counters[COUNTER_COUNT];
+};
+
+// Time per frame spent in one scope name, averaged over recent frames
+struct ProfileTotal {
+    const char *name;
+    double      ms_per_frame;
+    double      calls_per_frame;
+};
+
+class Profiler {
+    private:
+    chrono::steady_clock::time_point epoch;
+    ProfileFrame current;
+    bool         in_frame;
+
+    public:
+    deque<ProfileFrame> frames;
+    size_t              max_frames;
+
+    Profiler(size_t frames_kept = 600);
+
+    uint64_t now_ns() const {
+        return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - epoch).count();
+    }
+
+    void begin_frame();
+    void end_frame();
+
+    void record(const char *name, uint64_t start_ns, uint64_t end_ns) {
+        if(in_frame) current.samples.push_back({name, start_ns, end_ns - start_ns, 1});
+    }
+    void count(profile_counter counter, long n = 1) {
+        if(in_frame) current.counters[counter] += n;
+    }
+
+    // Another thread's finished frame, as a `frame_name` scope holding its
+    // samples on trace row tid, with its counters added to this frame's
+    void merge(const ProfileFrame &frame, const char *frame_name, int tid);
+
+    // Scope totals and counters over the last `last` finished frames
+    vector<ProfileTotal> totals(size_t last) const;
+    double average_counter(profile_counter counter, size_t last) const;
+    double average_frame_ms(size_t last) const;
+
+    // Chrome trace_event format, complete ("X") events plus counters
+    bool write_chrome_trace(const string &path) const;
+};
+
+Profiler *get_profiler();
+void set_profiler(Profiler *profiler);
+
+class ProfileScope {
+    private:
+    Profiler   *profiler;
+    const char *name;
+    uint64_t    start_ns;
+
+    public:
+    ProfileScope(const char *scope_name) {
+        profiler = get_profiler();
+        name = scope_name;
+        start_ns = profiler ? profiler->now_ns() : 0;
+    }
+    ~ProfileScope() {
+        if(profiler) profiler->record(name, start_ns, profiler->now_ns());
+    }
+
+    ProfileScope(const ProfileScope &) = delete;
+    ProfileScope &operator=(const ProfileScope &) = delete;
+};
+
+inline void profile_count(profile_counter counter, long n = 1) {
+    if(Profiler *profiler = get_profiler()) profiler->count(counter, n);
+}
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_CONCAT(profile_scope_, __LINE__)(name)
@@ -0,0 +1,85 @@
+#include <algorithm>
+#include "rollback.hpp"
+
+using namespace std;
+
+RollbackSession::RollbackSession(const PhysicsWorld &initial, int players, int rollback_frames, float tick_rate) : world(initial) {
+    tick_dt = 1.f/tick_rate;
+    player_count = max(1, players);
+    max_rollback = max(0, rollback_frames);
+    frames = 0;
+
+    // Room behind for max_rollback frames and the one being run, and as
+    // many ahead for inputs from a player further along
+    ring = 2*(max_rollback + 1);
+    state_size = world.state_size();
+    states.assign(ring*state_size, 0);
+    inputs.assign(ring*player_count, RollbackInput{UINT32_MAX, 0, 0, {0.f, 0.f}});
+    confirmed.assign(player_count, -1);
+    rollback_to = LONG_MAX;
+    counters = {0, 0, 0};
+}
+
+bool RollbackSession::add_input(const RollbackInput &input) {
+    long frame = input.frame;
+    if(input.player >= player_count || frame < frames - max_rollback || frame >= frames + ring - max_rollback) return false;
+
+    input_at(frame, input.player) = input;
+    long &last = confirmed[input.player];
+    while(last + 1 < frames + ring - max_rollback && input_at(last + 1, input.player).frame == (uint32_t)(last + 1)) {
+        last++;
+    }
+
+    // Not shooting is what was predicted, only a shot changes history
+    if(input.shoot && frame < frames) rollback_to = min(rollback_to, frame);
+    return true;
+}
+
+long RollbackSession::confirmed_frame() const {
+    return *min_element(confirmed.begin(), confirmed.end());
+}
+
+bool RollbackSession::can_advance() const {
+    return frames - confirmed_frame() <= max_rollback;
+}
+
+// The world before the frame's inputs is kept, so a rollback to it can
+// apply different ones. Shots follow the same rules as Simulation.
+void RollbackSession::step(long frame) {
+    world.save_state(&states[(frame % ring)*state_size]);
+
+    for(int p = 0; p < player_count; p++) {
+        const RollbackInput &input = input_at(frame, p);
+        if(input.frame != (uint32_t)frame || !input.shoot) continue;
+        if(!world.none_moving() || world.balls.is_pocketed(0)) continue;
+        world.balls.set_velocity(0, input.velocity);
+        world.wake(0);
+    }
+
+    world.update(tick_dt);
+
+    // Scratch, put the cue ball back once everything has stopped
+    if(world.balls.is_pocketed(0) && world.none_moving()) {
+        world.respot_ball(0, {0, line_distance});
+    }
+}
+
+void RollbackSession::resimulate() {
+    if(rollback_to >= frames) return;
+    long from = rollback_to;
+    rollback_to = LONG_MAX;
+
+    world.restore_state(&states[(from % ring)*state_size]);
+    for(long frame = from; frame < frames; frame++) {
+        step(frame);
+    }
+    counters.rollbacks++;
+    counters.frames_resimulated += frames - from;
+    counters.deepest = max(counters.deepest, frames - from);
+}
+
+void RollbackSession::advance() {
+    resimulate();
+    step(frames);
+    frames++;
+}
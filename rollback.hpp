@@ -0,0 +1,103 @@
+#include <vector>
+#include <cstdint>
+#include <climits>
+#include <type_traits>
+#include "physics.hpp"
+#include "fixed_step.hpp"
+
+#pragma once
+
+using namespace std;
+
+// One player's input for one frame, sent every frame whether or not the
+// player shot, so the other side knows which frames are settled. Plain
+// bytes on the wire.
+struct RollbackInput {
+    uint32_t       frame;
+    uint8_t        player;
+    uint8_t        shoot;
+    Vector2<float> velocity;
+};
+static_assert(is_trivially_copyable<RollbackInput>::value, "RollbackInput goes over the wire as bytes");
+
+struct RollbackStats {
+    long rollbacks;
+    long frames_resimulated;
+    // Most frames re-run by one rollback
+    long deepest;
+};
+
+// Networked play for a few players sharing one table, without lockstep. Each
+// side simulates ahead on its own inputs and predicts that everyone else
+// did not shoot. When a remote shot turns up for a frame already run,
+// the next advance() restores the world as it was before that frame and
+// runs every frame since again with the real inputs. Every player, the
+// local one too, sends an input for every frame.
+//
+// Before every frame the world goes into a ring of saved blocks with one
+// PhysicsWorld::save_state(), and the inputs sit in a ring of the same
+// length, so nothing allocates after the constructor. A player whose
+// inputs are more than max_rollback frames behind holds the session up:
+// can_advance() is false until they arrive.
+//
+// Both sides end up bitwise equal as long as both run the same build,
+// update() being deterministic for one dt.
+
+class RollbackSession {
+    private:
+    PhysicsWorld          world;
+    float                 tick_dt;
+    int                   player_count;
+    long                  frames;
+    // Ring of saved worlds and inputs, frame f at f % ring
+    long                  ring;
+    size_t                state_size;
+    vector<uint8_t>       states;
+    vector<RollbackInput> inputs;
+    // Newest frame each player's inputs are all in for, -1 for none
+    vector<long>          confirmed;
+    // Earliest frame a late shot changed, LONG_MAX when nothing did
+    long                  rollback_to;
+    RollbackStats         counters;
+
+    RollbackInput &input_at(long frame, int player) {
+        return inputs[(frame % ring)*player_count + player];
+    }
+    void step(long frame);
+
+    public:
+    int max_rollback;
+
+    RollbackSession(const PhysicsWorld &initial, int players = 2, int rollback_frames = 8,
+                    float tick_rate = default_tick_rate);
+
+    // Any player's input, local ones for the frame about to run. False
+    // when the frame is outside the window, older than max_rollback or
+    // too far ahead.
+    bool add_input(const RollbackInput &input);
+
+    // False while some player's inputs lag more than max_rollback frames
+    bool can_advance() const;
+
+    // Runs again from the earliest frame a late input changed, if any
+    void resimulate();
+
+    // resimulate(), then one new frame
+    void advance();
+
+    // Frames run so far, the next one to run
+    long frame() const {
+        return frames;
+    }
+
+    // Newest frame every player's inputs are in for
+    long confirmed_frame() const;
+
+    const PhysicsWorld &state() const {
+        return world;
+    }
+
+    RollbackStats stats() const {
+        return counters;
+    }
+};
@@ -0,0 +1,198 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <cstdint>
+#include "scenario.hpp"
+
+using namespace std;
+
+// Up to max numbers from the rest of a line, returns how many were read
+static int read_numbers(const char *at, float *out, int max) {
+    int count = 0;
+    while(count < max) {
+        char *end;
+        float value = strtof(at, &end);
+        if(end == at) break;
+        out[count++] = value;
+        at = end;
+    }
+    return count;
+}
+
+// Positive and finite, what radius, mass and friction have to be
+static bool positive(float value) {
+    return isfinite(value) && value > 0.f;
+}
+
+// Finite and near enough that the cushion grid stays small
+static bool on_table(float value) {
+    return isfinite(value) && fabsf(value) <= max_scenario_coordinate;
+}
+
+static bool add_cushions(PhysicsWorld *world, const float *points, int count, bool closed) {
+    if(count < 4 || count % 2 != 0) return false;
+    for(int i = 0; i < count; i++) {
+        if(!on_table(points[i])) return false;
+    }
+    int corners = count/2;
+    for(int i = 0; i + 1 < corners + (closed ? 1 : 0); i++) {
+        int next = (i + 1) % corners;
+        Vector2<float> p1 = {points[2*i], points[2*i + 1]}, p2 = {points[2*next], points[2*next + 1]};
+        // A cushion with no length has no normal
+        if(p1.x == p2.x && p1.y == p2.y) return false;
+        world->lines.push_back(Line(p1, p2));
+    }
+    return true;
+}
+
+bool parse_scenario(string text, PhysicsWorld *world, float *table_scale, string *error) {
+    PhysicsWorld scenario;
+    float scale = 1.f;
+    float radius = ball_size, mass = ball_mass, ball_friction = friction;
+    bool versioned = false;
+    vector<float> numbers;
+
+    // Each line becomes its own string, so number parsing stops at its end
+    size_t line_start = 0;
+    for(int line_number = 1; line_start < text.size(); line_number++) {
+        size_t line_end = text.find('\n', line_start);
+        if(line_end == string::npos) line_end = text.size();
+        else text[line_end] = 0;
+        const char *line = text.c_str() + line_start;
+        line_start = line_end + 1;
+
+        char keyword[32];
+        int used = 0;
+        if(sscanf(line, " %31s%n", keyword, &used) != 1 || keyword[0] == '#') continue;
+        numbers.resize(line_end - (line - text.c_str()));
+        int count = read_numbers(line + used, numbers.data(), numbers.size());
+
+        bool ok = true;
+        if(strcmp(keyword, "billiards-scenario") == 0) {
+            ok = count == 1 && numbers[0] == scenario_version;
+            versioned = ok;
+        }
+        else if(strcmp(keyword, "table_scale") == 0) {
+            ok = count == 1 && numbers[0] > 0;
+            if(ok) scale = numbers[0];
+        }
+        else if(strcmp(keyword, "pocket_radius") == 0) {
+            ok = count == 1 && positive(numbers[0]);
+            if(ok) scenario.pocket_radius = numbers[0];
+        }
+        else if(strcmp(keyword, "pocket") == 0) {
+            // A ball's pocket index is an int8_t
+            ok = count == 2 && isfinite(numbers[0]) && isfinite(numbers[1]) && scenario.pockets.size() < INT8_MAX;
+            if(ok) scenario.pockets.push_back({numbers[0], numbers[1]});
+        }
+        else if(strcmp(keyword, "cushion") == 0 || strcmp(keyword, "polygon") == 0) {
+            ok = add_cushions(&scenario, numbers.data(), count, keyword[0] == 'p');
+        }
+        else if(strcmp(keyword, "defaults") == 0) {
+            ok = count == 3 && positive(numbers[0]) && positive(numbers[1]) && positive(numbers[2]);
+            if(ok) {
+                radius = numbers[0];
+                mass = numbers[1];
+                ball_friction = numbers[2];
+            }
+        }
+        else if(strcmp(keyword, "ball") == 0) {
+            ok = count == 2 || count == 4 || count == 7 || count == 8;
+            if(ok) {
+                Ball ball(numbers[0], numbers[1], radius, mass, ball_friction, scenario.balls.size());
+                if(count >= 4) ball.velocity = {numbers[2], numbers[3]};
+                if(count >= 7) {
+                    ball.radius = numbers[4];
+                    ball.mass = numbers[5];
+                    ball.friction = numbers[6];
+                }
+                // Pockets are numbered in file order, so only ones above count
+                if(count == 8) {
+                    float pocket = numbers[7];
+                    ok = pocket == floorf(pocket) && pocket >= -1 && pocket < (float)scenario.pockets.size();
+                    ball.pocket = ok ? (int)pocket : -1;
+                }
+                ok = ok && isfinite(ball.position.x) && isfinite(ball.position.y) && isfinite(ball.velocity.x) &&
+                     isfinite(ball.velocity.y) && positive(ball.radius) && positive(ball.mass) && positive(ball.friction);
+                // A pocketed ball is parked, whatever velocity it was given
+                ball.is_moving = ball.pocket < 0 && (ball.velocity.x != 0 || ball.velocity.y != 0);
+                if(!ball.is_moving) ball.velocity = {0.f, 0.f};
+                if(ok) scenario.balls.push_back(ball);
+            }
+        }
+        else {
+            *error = "line " + to_string(line_number) + ": unknown item " + keyword;
+            return false;
+        }
+
+        if(!ok) {
+            *error = "line " + to_string(line_number) + ": bad " + keyword;
+            return false;
+        }
+    }
+    if(!versioned) {
+        *error = "not a billiards-scenario " + to_string(scenario_version) + " file";
+        return false;
+    }
+
+    // Balls are in, so the cushion grid gets built for their size
+    scenario.rebuild_cushions();
+    scenario.set_broad_phase(choose_broad_phase(scenario.balls.size()));
+    *world = scenario;
+    if(table_scale) *table_scale = scale;
+    return true;
+}
+
+bool load_scenario(const string &path, PhysicsWorld *world, float *table_scale, string *error) {
+    FILE *file = fopen(path.c_str(), "rb");
+    if(!file) {
+        *error = "could not open " + path;
+        return false;
+    }
+    string text;
+    char buffer[1 << 16];
+    size_t n;
+    while((n = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        text.append(buffer, n);
+    }
+    fclose(file);
+    return parse_scenario(move(text), world, table_scale, error);
+}
+
+bool save_scenario(const string &path, const PhysicsWorld &world, float table_scale) {
+    FILE *file = fopen(path.c_str(), "w");
+    if(!file) return false;
+
+    fprintf(file, "billiards-scenario %d\n", scenario_version);
+    fprintf(file, "table_scale %.9g\n", table_scale);
+    fprintf(file, "pocket_radius %.9g\n", world.pocket_radius);
+    for(auto &pocket : world.pockets) {
+        fprintf(file, "pocket %.9g %.9g\n", pocket.x, pocket.y);
+    }
+    for(auto &line : world.lines) {
+        fprintf(file, "cushion %.9g %.9g %.9g %.9g\n", line.p1.x, line.p1.y, line.p2.x, line.p2.y);
+    }
+
+    // Only what differs from the defaults line is written out per ball
+    const BallStore &balls = world.balls;
+    if(balls.size() > 0) fprintf(file, "defaults %.9g %.9g %.9g\n", balls.radius[0], balls.mass[0], balls.friction[0]);
+    for(size_t i = 0; i < balls.size(); i++) {
+        bool same = balls.radius[i] == balls.radius[0] && balls.mass[i] == balls.mass[0] && balls.friction[i] == balls.friction[0];
+        if(balls.pocket[i] >= 0) {
+            fprintf(file, "ball %.9g %.9g %.9g %.9g %.9g %.9g %.9g %d\n", balls.x[i], balls.y[i], balls.vx[i], balls.vy[i],
+                    balls.radius[i], balls.mass[i], balls.friction[i], balls.pocket[i]);
+        }
+        else if(!same) {
+            fprintf(file, "ball %.9g %.9g %.9g %.9g %.9g %.9g %.9g\n", balls.x[i], balls.y[i], balls.vx[i], balls.vy[i],
+                    balls.radius[i], balls.mass[i], balls.friction[i]);
+        }
+        else if(balls.is_moving(i)) {
+            fprintf(file, "ball %.9g %.9g %.9g %.9g\n", balls.x[i], balls.y[i], balls.vx[i], balls.vy[i]);
+        }
+        else {
+            fprintf(file, "ball %.9g %.9g\n", balls.x[i], balls.y[i]);
+        }
+    }
+    return fclose(file) == 0;
+}
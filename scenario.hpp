@@ -0,0 +1,37 @@
+#include <string>
+#include "physics.hpp"
+
+#pragma once
+
+using namespace std;
+
+// Plain text table and ball setup, one item per line, so tables other
+// than the standard one need no rebuild:
+//
+//   billiards-scenario 1
+//   # comment
+//   table_scale <s>                  how much the viewer scales the table image
+//   pocket_radius <r>
+//   pocket <x> <y>
+//   cushion <x1> <y1> <x2> <y2> ...  a cushion between each point and the next
+//   polygon <x1> <y1> <x2> <y2> ...  same, closed back to the first point
+//   ball <x> <y> [<vx> <vy> [<radius> <mass> <friction> [<pocket>]]]
+//   defaults <radius> <mass> <friction>
+//
+// Balls are numbered in file order, so the first one is the cue ball.
+// Omitted ball fields come from the last defaults line, or from the
+// standard ball before any. Radius, mass, friction and pocket_radius
+// must be positive, and a pocket index refers to the pocket lines above
+// the ball, of which there can be at most INT8_MAX. Cushion points must
+// lie within max_scenario_coordinate of the origin and no cushion can
+// have zero length. A ball given a velocity starts moving, unless it is
+// in a pocket.
+
+const int scenario_version = 1;
+const float max_scenario_coordinate = 20000;
+
+// The world is left as it was when the text does not parse
+bool parse_scenario(string text, PhysicsWorld *world, float *table_scale, string *error);
+bool load_scenario(const string &path, PhysicsWorld *world, float *table_scale, string *error);
+// Writes floats so they read back to the same bits
+bool save_scenario(const string &path, const PhysicsWorld &world, float table_scale);
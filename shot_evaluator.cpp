@@ -0,0 +1,112 @@
+#include <cmath>
+#include <random>
+#include "shot_evaluator.hpp"
+#include "event_engine.hpp"
+
+using namespace std;
+
+ShotOutcome simulate_shot(const PhysicsWorld &table, Vector2<float> cue_velocity, simulation_engine engine, float tick_dt, int max_ticks) {
+    // Each thread keeps its copy of the table, from the second shot on
+    // taking the copy reuses its storage instead of allocating
+    static thread_local PhysicsWorld world;
+    world = table;
+    // Shots already run on pool workers, which must not wait on a pool
+    world.contact_pool = nullptr;
+    world.balls.set_velocity(0, cue_velocity);
+    world.wake(0);
+
+    float elapsed = 0.f;
+    if(engine == EVENT_ENGINE) {
+        static thread_local EventEngine events;
+        events.reset(&world);
+        events.run_to_rest(&world, (long)max_ticks*sub_updates);
+        elapsed = events.time;
+    }
+    else {
+        for(int tick = 0; tick < max_ticks && !world.none_moving(); tick++) {
+            world.update(tick_dt);
+            elapsed += tick_dt;
+        }
+    }
+
+    ShotOutcome outcome;
+    outcome.balls_pocketed = 0;
+    for(size_t i = 0; i < world.balls.size(); i++) {
+        outcome.final_positions.push_back(world.balls.position(i));
+        outcome.pocket.push_back(world.balls.pocket[i]);
+        if(i != 0 && world.balls.is_pocketed(i)) outcome.balls_pocketed++;
+    }
+    outcome.scratch = world.balls.is_pocketed(0);
+    outcome.time_to_rest = elapsed;
+    return outcome;
+}
+
+vector<ShotOutcome> ShotEvaluator::evaluate(const PhysicsWorld &table, const vector<Vector2<float>> &cue_velocities) {
+    vector<ShotOutcome> outcomes(cue_velocities.size());
+
+    for(size_t k = 0; k < cue_velocities.size(); k++) {
+        pool.submit([this, &table, &cue_velocities, &outcomes, k] {
+            outcomes[k] = simulate_shot(table, cue_velocities[k], engine, tick_dt, max_ticks);
+        });
+    }
+    pool.wait_idle();
+    return outcomes;
+}
+
+vector<ShotStats> ShotEvaluator::evaluate_grid(const PhysicsWorld &table, const ShotGrid &grid) {
+    int samples = max(1, grid.noise_samples);
+    vector<Vector2<float>> velocities;
+    vector<ShotStats> stats;
+
+    for(int a = 0; a < grid.angle_steps; a++) {
+        for(int p = 0; p < grid.power_steps; p++) {
+            ShotStats cell{};
+            cell.angle = grid.angle_steps > 1 ? grid.angle_min + (grid.angle_max - grid.angle_min)*a/(grid.angle_steps - 1) : grid.angle_min;
+            cell.power = grid.power_steps > 1 ? grid.power_min + (grid.power_max - grid.power_min)*p/(grid.power_steps - 1) : grid.power_min;
+            cell.samples = samples;
+            stats.push_back(cell);
+
+            // Noise depends only on the seed and the cell, not on thread timing
+            mt19937 rng(grid.seed + 7919u*stats.size());
+            normal_distribution<float> angle_noise(0.f, grid.angle_noise);
+            normal_distribution<float> power_noise(0.f, grid.power_noise);
+            for(int s = 0; s < samples; s++) {
+                float angle = cell.angle + (s > 0 && grid.angle_noise > 0 ? angle_noise(rng) : 0.f);
+                float power = cell.power*(1.f + (s > 0 && grid.power_noise > 0 ? power_noise(rng) : 0.f));
+                velocities.push_back({cosf(angle)*power, sinf(angle)*power});
+            }
+        }
+    }
+
+    vector<ShotOutcome> outcomes = evaluate(table, velocities);
+
+    size_t balls = table.balls.size();
+    size_t pockets = table.pockets.size();
+    for(size_t c = 0; c < stats.size(); c++) {
+        ShotStats &cell = stats[c];
+        cell.scratch_rate = 0.f;
+        cell.mean_balls_pocketed = 0.f;
+        cell.pocket_rate.assign(balls*pockets, 0.f);
+        cell.mean_position.assign(balls, {0.f, 0.f});
+
+        for(int s = 0; s < samples; s++) {
+            const ShotOutcome &outcome = outcomes[c*samples + s];
+            cell.scratch_rate += outcome.scratch;
+            cell.mean_balls_pocketed += outcome.balls_pocketed;
+            for(size_t b = 0; b < balls; b++) {
+                if(outcome.pocket[b] >= 0) cell.pocket_rate[b*pockets + outcome.pocket[b]] += 1.f;
+                cell.mean_position[b] = cell.mean_position[b] + outcome.final_positions[b];
+            }
+        }
+
+        cell.scratch_rate /= samples;
+        cell.mean_balls_pocketed /= samples;
+        for(auto &rate : cell.pocket_rate) {
+            rate /= samples;
+        }
+        for(auto &position : cell.mean_position) {
+            position = position/(float)samples;
+        }
+    }
+    return stats;
+}
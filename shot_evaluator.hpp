@@ -0,0 +1,77 @@
+#include <vector>
+#include <cstdint>
+#include "physics.hpp"
+#include "thread_pool.hpp"
+
+#pragma once
+
+using namespace std;
+
+enum simulation_engine {
+    SUB_STEP_ENGINE,
+    EVENT_ENGINE
+};
+
+// Where one simulated shot left the table
+struct ShotOutcome {
+    vector<Vector2<float>> final_positions;
+    // Pocket index per ball, same order as Table::hole_position, -1 if none
+    vector<int8_t>         pocket;
+    int                    balls_pocketed;
+    bool                   scratch;
+    float                  time_to_rest;
+};
+
+// Angle x power grid of cue velocities, each cell sampled noise_samples
+// times with gaussian noise on the angle (radians) and the power (as a
+// fraction of it). Angles are measured like atan2(vy, vx).
+struct ShotGrid {
+    float    angle_min, angle_max;
+    int      angle_steps;
+    float    power_min, power_max;
+    int      power_steps;
+    int      noise_samples;
+    float    angle_noise, power_noise;
+    unsigned seed;
+};
+
+// Outcome statistics for one grid cell
+struct ShotStats {
+    float          angle, power;
+    int            samples;
+    float          scratch_rate;
+    float          mean_balls_pocketed;
+    // Fraction of samples that sank ball b in pocket p, at [b*pockets + p]
+    vector<float>  pocket_rate;
+    vector<Vector2<float>> mean_position;
+};
+
+// Runs one shot on a private copy of the table until every ball rests
+ShotOutcome simulate_shot(const PhysicsWorld &table, Vector2<float> cue_velocity, simulation_engine engine, float tick_dt, int max_ticks);
+
+// Simulates many candidate shots in parallel. Every task gets its own
+// copy of the table and writes only its own result slot, so nothing
+// mutable is shared between threads.
+
+class ShotEvaluator {
+    private:
+    ThreadPool pool;
+
+    public:
+    simulation_engine engine;
+    float             tick_dt;
+    int               max_ticks;
+
+    ShotEvaluator(size_t threads = 0) : pool(threads) {
+        engine = SUB_STEP_ENGINE;
+        tick_dt = 1.f/120.f;
+        max_ticks = 120*60;
+    }
+
+    size_t threads() const {
+        return pool.size();
+    }
+
+    vector<ShotOutcome> evaluate(const PhysicsWorld &table, const vector<Vector2<float>> &cue_velocities);
+    vector<ShotStats> evaluate_grid(const PhysicsWorld &table, const ShotGrid &grid);
+};
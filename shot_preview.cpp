@@ -0,0 +1,220 @@
+#include <cmath>
+#include "shot_preview.hpp"
+
+using namespace std;
+
+ShotPreview::ShotPreview(const PhysicsWorld &initial, float tick_rate) : table(initial) {
+    // The simulation waits on that pool, the pool only changes speed
+    table.contact_pool = nullptr;
+    tick_dt = 1.f/tick_rate;
+    max_ticks = (int)(tick_rate*8);
+    slice = chrono::microseconds(1000);
+    budget = chrono::microseconds(30000);
+    angle_threshold = .002f;
+    power_threshold = .01f;
+
+    version = 0;
+    requests_sent = 0;
+    last_velocity = {0, 0};
+    pending = 0;
+
+    // The reader has to find a complete prediction before the first one
+    for(int i = 0; i < 3; i++) {
+        ShotPrediction &empty = predictions.write_slot();
+        empty.table_version = -1;
+        empty.first_contact = -1;
+        empty.cue_pocket = -1;
+        empty.complete = false;
+        empty.request = 0;
+        empty.finished = true;
+        predictions.publish();
+    }
+
+    running = true;
+    worker = thread(&ShotPreview::run, this);
+}
+
+ShotPreview::~ShotPreview() {
+    {
+        lock_guard<mutex> lock(wake_lock);
+        running = false;
+    }
+    wake.notify_one();
+    worker.join();
+}
+
+// Caller side
+
+void ShotPreview::aim(const vector<float> &x, const vector<float> &y, const vector<uint32_t> &flags, Vector2<float> velocity) {
+    bool moved_balls = x != last_x || y != last_y;
+    if(moved_balls) {
+        last_x = x;
+        last_y = y;
+        version++;
+    }
+    else if(requests_sent > 0) {
+        // Angle between the two aims
+        float speed = magnitude(velocity), last_speed = magnitude(last_velocity);
+        float turn = atan2f(fabsf(velocity.x*last_velocity.y - velocity.y*last_velocity.x), dot(velocity, last_velocity));
+        if(turn <= angle_threshold && fabsf(speed - last_speed) <= power_threshold*last_speed) return;
+    }
+    last_velocity = velocity;
+
+    PreviewRequest &request = requests.write_slot();
+    request.id = ++requests_sent;
+    request.table_version = version;
+    request.velocity = velocity;
+    request.x = x;
+    request.y = y;
+    request.flags = flags;
+    requests.publish();
+
+    // Held by the worker only to check pending and go to sleep
+    {
+        lock_guard<mutex> lock(wake_lock);
+        pending = request.id;
+    }
+    wake.notify_one();
+}
+
+// Worker
+
+void ShotPreview::run() {
+    long handled = 0;
+    while(true) {
+        {
+            unique_lock<mutex> lock(wake_lock);
+            wake.wait(lock, [&] { return !running || pending != handled; });
+            if(!running) return;
+        }
+        const PreviewRequest &request = requests.read();
+        handled = request.id;
+        predict(request);
+    }
+}
+
+void ShotPreview::publish() {
+    predictions.write_slot() = current;
+    predictions.publish();
+}
+
+void ShotPreview::predict(const PreviewRequest &request) {
+    auto start = chrono::steady_clock::now();
+    if(request.x.size() != table.balls.size() || request.y.size() != table.balls.size() ||
+       request.flags.size() != table.balls.size()) {
+        // Nothing to draw for it, but the aim is answered so caught_up() holds
+        current.table_version = request.table_version;
+        current.velocity = request.velocity;
+        current.path.clear();
+        current.bounces.clear();
+        current.first_contact = -1;
+        current.cue_pocket = -1;
+        current.complete = false;
+        current.request = request.id;
+        current.finished = true;
+        publish();
+        return;
+    }
+
+    // The table at rest as the player sees it, then the cue ball hit.
+    // Copying into the same world every time allocates nothing.
+    world = table;
+    BallStore &balls = world.balls;
+    for(size_t i = 0; i < balls.size(); i++) {
+        balls.x[i] = request.x[i];
+        balls.y[i] = request.y[i];
+        balls.vx[i] = 0;
+        balls.vy[i] = 0;
+        balls.flags[i] = request.flags[i] & ~(uint32_t)BALL_MOVING;
+    }
+    balls.set_velocity(0, request.velocity);
+    world.wake(0);
+
+    current.table_version = request.table_version;
+    current.velocity = request.velocity;
+    current.path.clear();
+    current.bounces.clear();
+    current.first_contact = -1;
+    current.contact_position = {0, 0};
+    current.object_direction = {0, 0};
+    current.cue_pocket = -1;
+    current.complete = false;
+    current.request = request.id;
+    current.finished = false;
+    current.path.push_back(balls.position(0));
+
+    auto slice_end = start + slice;
+    for(int t = 0; t < max_ticks; t++) {
+        if(!step()) {
+            current.complete = true;
+            break;
+        }
+
+        auto now = chrono::steady_clock::now();
+        if(now < slice_end) continue;
+        // Show what there is so far, then give up on it if the aim moved on
+        publish();
+        if(pending != request.id || !running) return;
+        if(now - start >= budget) break;
+        // Let the render thread in when it shares the core
+        this_thread::yield();
+        slice_end = chrono::steady_clock::now() + slice;
+    }
+    current.finished = true;
+    publish();
+}
+
+// Same sub-steps as PhysicsWorld::update, fixed or adaptive. Between contacts friction only
+// shortens the cue ball's velocity, so any turn is a contact: the first
+// one that woke another ball is the first contact, one touching a
+// cushion is a bounce.
+bool ShotPreview::step() {
+    BallStore &balls = world.balls;
+    int steps = world.sub_steps(tick_dt);
+    float sub_dt = tick_dt/steps;
+    for(int s = 0; s < steps; s++) {
+        Vector2<float> before = balls.velocity(0);
+        world.sub_update(sub_dt);
+        world.ball_to_ball_collision();
+        world.check_ball_line_collision();
+        world.check_ball_pocket_collision();
+
+        if(balls.is_pocketed(0)) {
+            current.cue_pocket = balls.pocket[0];
+            if(current.cue_pocket >= 0) current.path.push_back(world.pockets[current.cue_pocket]);
+            return false;
+        }
+
+        Vector2<float> after = balls.velocity(0);
+        float turn = before.x*after.y - before.y*after.x;
+        bool turned = dot(before, after) < 0 || fabsf(turn) > 1e-3f*magnitude(before)*magnitude(after);
+        if(!turned) continue;
+
+        Vector2<float> position = balls.position(0);
+        current.path.push_back(position);
+        if(current.first_contact < 0) {
+            float nearest = INFINITY;
+            for(size_t k = 1; k < balls.size(); k++) {
+                if(!balls.is_moving(k)) continue;
+                float gap = distance_squared(position, balls.position(k));
+                if(gap < nearest) {
+                    nearest = gap;
+                    current.first_contact = k;
+                }
+            }
+            if(current.first_contact >= 0) {
+                current.contact_position = position;
+                current.object_direction = unit(balls.velocity(current.first_contact));
+                continue;
+            }
+        }
+        for(auto &line : world.lines) {
+            if(line.collision(position, balls.radius[0] + 1)) {
+                current.bounces.push_back(position);
+                break;
+            }
+        }
+    }
+    current.path.push_back(balls.position(0));
+    return balls.is_moving(0);
+}
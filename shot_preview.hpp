@@ -0,0 +1,125 @@
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include "physics.hpp"
+#include "fixed_step.hpp"
+#include "triple_buffer.hpp"
+
+#pragma once
+
+using namespace std;
+
+// Where the cue ball would go for one aim, what the aim overlay draws
+struct ShotPrediction {
+    // Which table it was made for, see ShotPreview::table_version()
+    long                   table_version;
+    Vector2<float>         velocity;
+    // Cue ball centre from the shot on, a point per tick and one at every contact
+    vector<Vector2<float>> path;
+    // Cue ball centre at each cushion bounce
+    vector<Vector2<float>> bounces;
+    // First ball the cue ball hits, -1 if none
+    int                    first_contact;
+    Vector2<float>         contact_position;
+    // Direction that ball leaves in, unit length
+    Vector2<float>         object_direction;
+    // Pocket the cue ball drops into, -1 if none
+    int                    cue_pocket;
+    // False while the worker is still extending the path, or when it ran out of budget
+    bool                   complete;
+    // Id of the aim it answers, and whether the worker is done with it
+    long                   request;
+    bool                   finished;
+};
+
+struct PreviewRequest {
+    long             id;
+    long             table_version;
+    Vector2<float>   velocity;
+    vector<float>    x, y;
+    vector<uint32_t> flags;
+};
+
+// Predicts the shot the player is aiming on a worker thread, with the same
+// sub-steps PhysicsWorld::update runs, so the path is the one the shot
+// will take. aim() is called every frame but only asks for a new
+// prediction when the table changed or the aim moved past a threshold.
+// Requests and results go through triple buffers, so the render loop
+// never waits on the worker.
+//
+// The worker publishes the path so far every `slice` of work and drops
+// it as soon as a newer aim comes in. A path still unfinished after
+// `budget` is published as it is, with complete false.
+
+class ShotPreview {
+    private:
+    // The table as first given, with its cushions, pockets and ball sizes
+    PhysicsWorld table;
+    // Worker only
+    PhysicsWorld   world;
+    ShotPrediction current;
+
+    TripleBuffer<PreviewRequest> requests;
+    TripleBuffer<ShotPrediction> predictions;
+
+    // Caller side
+    long             version;
+    long             requests_sent;
+    Vector2<float>   last_velocity;
+    vector<float>    last_x, last_y;
+
+    thread             worker;
+    atomic<bool>       running;
+    // Id of the newest request published
+    atomic<long>       pending;
+    mutex              wake_lock;
+    condition_variable wake;
+
+    void run();
+    void predict(const PreviewRequest &request);
+    // Sub-steps one tick, false once the cue ball stopped or dropped
+    bool step();
+    void publish();
+
+    public:
+    float                tick_dt;
+    // Longest path, in ticks
+    int                  max_ticks;
+    chrono::microseconds slice;
+    chrono::microseconds budget;
+    // How far the aim moves before it is predicted again, radians and a
+    // fraction of the power
+    float                angle_threshold;
+    float                power_threshold;
+
+    ShotPreview(const PhysicsWorld &initial, float tick_rate = default_tick_rate);
+    ~ShotPreview();
+
+    ShotPreview(const ShotPreview &) = delete;
+    ShotPreview &operator=(const ShotPreview &) = delete;
+
+    // Caller side, one thread only. Balls as they rest now and the cue
+    // velocity a click would give
+    void aim(const vector<float> &x, const vector<float> &y, const vector<uint32_t> &flags, Vector2<float> velocity);
+
+    // Bumped whenever aim() sees the balls somewhere new, a prediction
+    // for an older version is stale
+    long table_version() const {
+        return version;
+    }
+
+    // The newest prediction, valid until the next call
+    const ShotPrediction &latest() {
+        return predictions.read();
+    }
+
+    // True once the newest aim has its last prediction, nothing changes
+    // until aim() asks for another
+    bool caught_up() {
+        const ShotPrediction &prediction = latest();
+        return prediction.request == requests_sent && prediction.finished;
+    }
+};
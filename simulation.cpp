@@ -0,0 +1,148 @@
+#include <algorithm>
+#include "simulation.hpp"
+
+using namespace std;
+
+Simulation::Simulation(const PhysicsWorld &initial, float tick_rate, bool use_events) : world(initial), stepper(tick_rate), tick_profiler(1) {
+    event_driven = use_events;
+    running = false;
+    shots_taken = 0;
+    rest_published = false;
+    if(event_driven) engine.reset(&world);
+
+    // The reader has to find a complete snapshot before the first tick
+    for(int i = 0; i < 3; i++) {
+        WorldSnapshot &snapshot = snapshots.write_slot();
+        snapshot.tick = 0;
+        snapshot.published = chrono::steady_clock::now();
+        snapshot.x.assign(world.balls.x.begin(), world.balls.x.end());
+        snapshot.y.assign(world.balls.y.begin(), world.balls.y.end());
+        snapshot.previous_x = snapshot.x;
+        snapshot.previous_y = snapshot.y;
+        snapshot.flags.assign(world.balls.flags.begin(), world.balls.flags.end());
+        snapshot.none_moving = world.none_moving();
+        snapshots.publish();
+    }
+}
+
+Simulation::~Simulation() {
+    stop();
+}
+
+void Simulation::apply(const SimCommand &command) {
+    switch(command.type) {
+        case SIM_SHOOT: {
+            if(!world.none_moving()) break;
+            world.balls.set_velocity(0, command.velocity);
+            world.wake(0);
+            if(event_driven) engine.reset(&world);
+
+            shots_taken++;
+            if(!record_prefix.empty()) {
+                string path = record_prefix + "_" + to_string(shots_taken) + ".traj";
+                if(recorder.open(path, world.balls.size(), stepper.tick_dt)) recorder.record_tick(world.balls);
+            }
+            break;
+        }
+    }
+}
+
+void Simulation::tick() {
+    SimCommand command;
+    while(commands.pop(&command)) {
+        apply(command);
+    }
+
+    // A resting table stays as the last snapshot showed it, once that
+    // snapshot has no motion left to interpolate
+    bool resting = world.none_moving();
+    if(resting && rest_published) return;
+    rest_published = resting;
+
+    WorldSnapshot &snapshot = snapshots.write_slot();
+    snapshot.previous_x.assign(world.balls.x.begin(), world.balls.x.end());
+    snapshot.previous_y.assign(world.balls.y.begin(), world.balls.y.end());
+
+    if(event_driven) {
+        engine.advance(&world, stepper.tick_dt);
+    }
+    else {
+        world.update(stepper.tick_dt);
+    }
+
+    // Scratch, put the cue ball back once everything has stopped
+    if(world.balls.is_pocketed(0) && world.none_moving()) {
+        world.respot_ball(0, {0, line_distance});
+        if(event_driven) engine.reset(&world);
+    }
+
+    if(recorder.is_open()) {
+        recorder.record_tick(world.balls);
+        if(world.none_moving()) recorder.close();
+    }
+
+    snapshot.tick = stepper.ticks + 1;
+    snapshot.published = chrono::steady_clock::now();
+    snapshot.x.assign(world.balls.x.begin(), world.balls.x.end());
+    snapshot.y.assign(world.balls.y.begin(), world.balls.y.end());
+    snapshot.flags.assign(world.balls.flags.begin(), world.balls.flags.end());
+    snapshot.none_moving = world.none_moving();
+    snapshots.publish();
+}
+
+void Simulation::pump(float frame_dt) {
+    if(threaded()) return;
+    stepper.advance(&world, frame_dt, [this](float) {
+        tick();
+    });
+}
+
+void Simulation::run() {
+    auto tick_length = chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<float>(stepper.tick_dt));
+    auto next_tick = chrono::steady_clock::now();
+    set_profiler(&tick_profiler);
+
+    while(running) {
+        tick_profiler.begin_frame();
+        tick();
+        tick_profiler.end_frame();
+        stepper.ticks++;
+
+        // Dropped while the render thread is not collecting
+        const ProfileFrame &frame = tick_profiler.frames.back();
+        if(!frame.samples.empty()) tick_profiles.push(frame);
+
+        // Too far behind, drop the time instead of spiralling
+        next_tick += tick_length;
+        auto now = chrono::steady_clock::now();
+        if(now - next_tick > tick_length*stepper.max_catch_up) next_tick = now;
+        this_thread::sleep_until(next_tick);
+    }
+}
+
+void Simulation::start() {
+    if(threaded()) return;
+    running = true;
+    worker = thread(&Simulation::run, this);
+}
+
+void Simulation::stop() {
+    if(!threaded()) return;
+    running = false;
+    worker.join();
+}
+
+void Simulation::collect_profile(Profiler *profiler) {
+    ProfileFrame frame;
+    while(tick_profiles.pop(&frame)) {
+        profiler->merge(frame, "physics_tick", 2);
+    }
+}
+
+float Simulation::alpha(const WorldSnapshot &snapshot) const {
+    if(!threaded()) return stepper.alpha();
+
+    // The newest tick is shown fully one tick after it was published
+    float since = chrono::duration<float>(chrono::steady_clock::now() - snapshot.published).count();
+    return clamp(since/stepper.tick_dt, 0.f, 1.f);
+}
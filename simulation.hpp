@@ -0,0 +1,134 @@
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include "physics.hpp"
+#include "event_engine.hpp"
+#include "fixed_step.hpp"
+#include "triple_buffer.hpp"
+#include "spsc_queue.hpp"
+#include "trajectory.hpp"
+#include "profiler.hpp"
+
+#pragma once
+
+using namespace std;
+
+// What the renderer sees of the world after one physics tick. Positions
+// one tick earlier come along so drawing can interpolate between them.
+
+struct WorldSnapshot {
+    long             tick;
+    chrono::steady_clock::time_point published;
+    vector<float>    x, y;
+    vector<float>    previous_x, previous_y;
+    vector<uint32_t> flags;
+    bool             none_moving;
+
+    size_t size() const {
+        return x.size();
+    }
+
+    Vector2<float> position(size_t i) const {
+        return {x[i], y[i]};
+    }
+
+    bool is_pocketed(size_t i) const {
+        return flags[i] & BALL_POCKETED;
+    }
+
+    Vector2<float> interpolated_position(size_t i, float alpha) const {
+        Vector2<float> previous = {previous_x[i], previous_y[i]};
+        return previous + (position(i) - previous)*alpha;
+    }
+};
+
+enum sim_command_type {
+    // Hit the cue ball, ignored unless every ball is at rest
+    SIM_SHOOT
+};
+
+struct SimCommand {
+    sim_command_type type;
+    Vector2<float>   velocity;
+};
+
+// Owns the PhysicsWorld and steps it at a fixed tick, either on its own
+// thread after start() or on the caller's thread through pump(). Input
+// comes in through a single-producer queue and every tick is published
+// as a snapshot through a triple buffer, so the render loop never locks
+// and never sees a half-updated world.
+
+class Simulation {
+    private:
+    PhysicsWorld world;
+    EventEngine  engine;
+    bool         event_driven;
+    FixedStepper stepper;
+
+    TripleBuffer<WorldSnapshot> snapshots;
+    SpscQueue<SimCommand, 64>   commands;
+
+    thread       worker;
+    atomic<bool> running;
+    // The newest snapshot shows the table at rest with nothing moving
+    // since the one before, so idle ticks need not publish
+    bool         rest_published;
+
+    // The physics thread's own profiler, each tick that did anything
+    // goes to the render thread through tick_profiles
+    Profiler                    tick_profiler;
+    SpscQueue<ProfileFrame, 64> tick_profiles;
+
+    // Every shot recorded to <record_prefix>_<n>.traj when set
+    string           record_prefix;
+    long             shots_taken;
+    TrajectoryWriter recorder;
+
+    void apply(const SimCommand &command);
+    void tick();
+    void run();
+
+    public:
+    Simulation(const PhysicsWorld &initial, float tick_rate = default_tick_rate, bool use_events = false);
+    ~Simulation();
+
+    Simulation(const Simulation &) = delete;
+    Simulation &operator=(const Simulation &) = delete;
+
+    // Moves physics to its own thread, ticking in real time
+    void start();
+    void stop();
+    bool threaded() const {
+        return worker.joinable();
+    }
+
+    // Call before start()
+    void record_shots(const string &prefix) {
+        record_prefix = prefix;
+    }
+
+    // Without a thread, runs the ticks owed for frame_dt right here
+    void pump(float frame_dt);
+
+    // Producer side, one thread only. False when the queue is full
+    bool send(const SimCommand &command) {
+        return commands.push(command);
+    }
+
+    // Consumer side, one thread only
+    const WorldSnapshot &latest() {
+        return snapshots.read();
+    }
+
+    // Consumer side. Merges the physics thread's ticks since the last
+    // call into profiler's current frame, without a thread there are none
+    void collect_profile(Profiler *profiler);
+
+    // How far drawing is between snapshot.previous and snapshot, 0 to 1
+    float alpha(const WorldSnapshot &snapshot) const;
+
+    float tick_dt() const {
+        return stepper.tick_dt;
+    }
+};
@@ -0,0 +1,40 @@
+#include <atomic>
+#include <cstddef>
+
+#pragma once
+
+using namespace std;
+
+// Bounded lock-free queue for exactly one producer thread and one
+// consumer thread. push() fails instead of blocking when it is full.
+
+template<class T, size_t capacity>
+class SpscQueue {
+    private:
+    T items[capacity];
+    // Kept on separate cache lines, each is written by one side only
+    alignas(64) atomic<size_t> head;
+    alignas(64) atomic<size_t> tail;
+
+    public:
+    SpscQueue() : head(0), tail(0) {}
+
+    SpscQueue(const SpscQueue &) = delete;
+    SpscQueue &operator=(const SpscQueue &) = delete;
+
+    bool push(const T &item) {
+        size_t t = tail.load(memory_order_relaxed);
+        if(t - head.load(memory_order_acquire) == capacity) return false;
+        items[t % capacity] = item;
+        tail.store(t + 1, memory_order_release);
+        return true;
+    }
+
+    bool pop(T *item) {
+        size_t h = head.load(memory_order_relaxed);
+        if(h == tail.load(memory_order_acquire)) return false;
+        *item = items[h % capacity];
+        head.store(h + 1, memory_order_release);
+        return true;
+    }
+};
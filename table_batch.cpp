@@ -0,0 +1,537 @@
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include "table_batch.hpp"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define TABLE_BATCH_X86
+#endif
+
+// Lane helpers never leave this file, so the AVX calling convention
+// warning for vector returns does not matter
+#pragma GCC diagnostic ignored "-Wpsabi"
+
+using namespace std;
+
+// The lane kernels are written once with vector extensions and inlined
+// into a default and an AVX2 entry point, the CPU picks one at run time.
+// Comparisons give all bits set in the lanes where they hold, and every
+// store is a select on such a mask so stopped lanes never change.
+//
+// Lane values only live in registers and locals. Block storage stays in
+// plain float arrays read with unaligned loads, since the alignment of a
+// vector type changes with the target it is compiled for.
+
+typedef float   lane_float __attribute__((vector_size(batch_lanes*sizeof(float))));
+typedef int32_t lane_int   __attribute__((vector_size(batch_lanes*sizeof(int32_t))));
+
+#define LANES_INLINE inline __attribute__((always_inline))
+
+// Flag bits as plain ints, vector operators do not take enums
+const int32_t moving_bit = BALL_MOVING;
+const int32_t pocketed_bit = BALL_POCKETED;
+
+template<class V, class T>
+static LANES_INLINE V load(const T *at) {
+    V value;
+    memcpy(&value, at, sizeof(V));
+    return value;
+}
+
+template<class V, class T>
+static LANES_INLINE void store(T *at, V value) {
+    memcpy(at, &value, sizeof(V));
+}
+
+// Ball k of every table in the block
+struct BallLanes {
+    lane_float x, y, vx, vy;
+    lane_int   flags;
+};
+
+static LANES_INLINE BallLanes load_ball(const BatchBlock *block, size_t k) {
+    size_t at = k*batch_lanes;
+    return {load<lane_float>(&block->x[at]), load<lane_float>(&block->y[at]),
+            load<lane_float>(&block->vx[at]), load<lane_float>(&block->vy[at]),
+            load<lane_int>(&block->flags[at])};
+}
+
+static LANES_INLINE void store_ball(BatchBlock *block, size_t k, const BallLanes &ball) {
+    size_t at = k*batch_lanes;
+    store(&block->x[at], ball.x);
+    store(&block->y[at], ball.y);
+    store(&block->vx[at], ball.vx);
+    store(&block->vy[at], ball.vy);
+    store(&block->flags[at], ball.flags);
+}
+
+static LANES_INLINE lane_float splat(float value) {
+    return lane_float{} + value;
+}
+
+static LANES_INLINE lane_float lane_abs(lane_float value) {
+    return (lane_float)((lane_int)value & 0x7fffffff);
+}
+
+// Folds the lanes together in halves, cheaper than reading out each one
+static LANES_INLINE bool any(lane_int mask) {
+    typedef int64_t lane_pair __attribute__((vector_size(sizeof(lane_int))));
+    typedef int64_t pair_index __attribute__((vector_size(sizeof(lane_int))));
+    lane_pair folded = (lane_pair)mask;
+    folded |= __builtin_shuffle(folded, pair_index{2, 3, 0, 1});
+    folded |= __builtin_shuffle(folded, pair_index{1, 0, 3, 2});
+    return folded[0] != 0;
+}
+
+// Only runs on contacts, so a root per lane costs little
+static LANES_INLINE lane_float lane_sqrt(lane_float value) {
+    lane_float root;
+    for(size_t l = 0; l < batch_lanes; l++) {
+        root[l] = scalar_sqrt(value[l]);
+    }
+    return root;
+}
+
+static LANES_INLINE lane_int is_moving(lane_int flags) {
+    return (flags & moving_bit) != 0;
+}
+
+// Same as integrate_one() in ball_store.cpp
+static LANES_INLINE void integrate_lanes(const BatchTable &table, BatchBlock *block, lane_int running, float dt) {
+    const lane_float zero = splat(0.f);
+    const lane_float threshold_squared = splat(moving_threshold*moving_threshold);
+
+    for(size_t k = 0; k < table.radius.size(); k++) {
+        BallLanes ball = load_ball(block, k);
+        lane_int awake = is_moving(ball.flags) & running;
+        if(!any(awake)) continue;
+
+        lane_float ax = ball.vx*table.friction[k]*-1.f;
+        lane_float ay = ball.vy*table.friction[k]*-1.f;
+
+        lane_float x = ball.x + ball.vx*dt + ax*dt*dt/2.f;
+        lane_float y = ball.y + ball.vy*dt + ay*dt*dt/2.f;
+        lane_float vx = ball.vx + ax*dt;
+        lane_float vy = ball.vy + ay*dt;
+
+        lane_float speed_squared = vx*vx + vy*vy;
+        lane_int stop = awake & (speed_squared < threshold_squared);
+
+        ball.x = awake ? x : ball.x;
+        ball.y = awake ? y : ball.y;
+        ball.vx = stop ? zero : (awake ? vx : ball.vx);
+        ball.vy = stop ? zero : (awake ? vy : ball.vy);
+        ball.flags = stop ? (ball.flags & ~moving_bit) : ball.flags;
+        store_ball(block, k, ball);
+    }
+}
+
+// A sleeping ball that was hit wakes or is zeroed, as settle_contact()
+static LANES_INLINE void settle_lanes(BallLanes *ball, lane_int contact) {
+    lane_int sleeping = contact & ~is_moving(ball->flags);
+    if(!any(sleeping)) return;
+
+    lane_float speed_squared = ball->vx*ball->vx + ball->vy*ball->vy;
+    lane_int wake = sleeping & (speed_squared >= moving_threshold*moving_threshold);
+    lane_int zero = sleeping & ~wake;
+    ball->flags = wake ? (ball->flags | moving_bit) : ball->flags;
+    ball->vx = zero ? splat(0.f) : ball->vx;
+    ball->vy = zero ? splat(0.f) : ball->vy;
+}
+
+// Box test of every pair with a ball awake, all found before any is
+// resolved, then collide_balls() lane by lane in pair order. Pairs of
+// balls asleep in every lane are skipped without loading them.
+static LANES_INLINE void collide_lanes(const BatchTable &table, BatchBlock *block, lane_int running) {
+    for(size_t k = 0; k < table.radius.size(); k++) {
+        block->awake[k] = any(is_moving(load<lane_int>(&block->flags[k*batch_lanes])) & running);
+    }
+
+    block->found.clear();
+    for(uint32_t p = 0; p < table.pairs.size(); p++) {
+        if(!block->awake[table.pairs[p].i] && !block->awake[table.pairs[p].j]) continue;
+        size_t i = table.pairs[p].i*batch_lanes, j = table.pairs[p].j*batch_lanes;
+        float reach = table.radius[table.pairs[p].i] + table.radius[table.pairs[p].j];
+        lane_int flags = load<lane_int>(&block->flags[i]) | load<lane_int>(&block->flags[j]);
+        lane_int hit = is_moving(flags) & running &
+                       (lane_abs(load<lane_float>(&block->x[i]) - load<lane_float>(&block->x[j])) <= reach) &
+                       (lane_abs(load<lane_float>(&block->y[i]) - load<lane_float>(&block->y[j])) <= reach);
+        if(!any(hit)) continue;
+        store(&block->candidates[p*batch_lanes], hit);
+        block->found.push_back(p);
+    }
+
+    const lane_float zero = splat(0.f);
+    for(uint32_t p : block->found) {
+        size_t i = table.pairs[p].i, j = table.pairs[p].j;
+        BallLanes ball_i = load_ball(block, i);
+        BallLanes ball_j = load_ball(block, j);
+        lane_int contact = load<lane_int>(&block->candidates[p*batch_lanes]) & (((ball_i.flags | ball_j.flags) & pocketed_bit) == 0);
+
+        lane_float gap_x = ball_i.x - ball_j.x;
+        lane_float gap_y = ball_i.y - ball_j.y;
+        float reach = table.radius[i] + table.radius[j];
+        lane_float gap_squared = gap_x*gap_x + gap_y*gap_y;
+        contact &= gap_squared <= reach*reach;
+        if(!any(contact)) continue;
+
+        lane_float gap_length = lane_sqrt(gap_squared);
+        lane_float overshot = gap_length - reach;
+        lane_int centred = gap_length == zero;
+        lane_float normal_x = centred ? zero : gap_x/gap_length;
+        lane_float normal_y = centred ? zero : gap_y/gap_length;
+
+        // Split each velocity along the normal and swap the normal parts
+        lane_float dot_i = ball_i.vx*normal_x + ball_i.vy*normal_y;
+        lane_float velocity_xi_x = normal_x*dot_i, velocity_xi_y = normal_y*dot_i;
+        lane_float velocity_yi_x = ball_i.vx - velocity_xi_x, velocity_yi_y = ball_i.vy - velocity_xi_y;
+        lane_float dot_j = ball_j.vx*normal_x + ball_j.vy*normal_y;
+        lane_float velocity_xj_x = normal_x*dot_j, velocity_xj_y = normal_y*dot_j;
+        lane_float velocity_yj_x = ball_j.vx - velocity_xj_x, velocity_yj_y = ball_j.vy - velocity_xj_y;
+
+        float mass_i = table.mass[i], mass_j = table.mass[j];
+        float total = mass_i + mass_j;
+        float keep_i = (mass_i - mass_j)/total, take_i = (2.f*mass_j)/total;
+        float take_j = (2.f*mass_i)/total, keep_j = (mass_j - mass_i)/total;
+
+        lane_float vx_i = (velocity_xi_x*keep_i) + (velocity_xj_x*take_i) + velocity_yi_x;
+        lane_float vy_i = (velocity_xi_y*keep_i) + (velocity_xj_y*take_i) + velocity_yi_y;
+        lane_float vx_j = (velocity_xi_x*take_j) + (velocity_xj_x*keep_j) + velocity_yj_x;
+        lane_float vy_j = (velocity_xi_y*take_j) + (velocity_xj_y*keep_j) + velocity_yj_y;
+
+        lane_float correction_x = normal_x*overshot, correction_y = normal_y*overshot;
+        ball_i.vx = contact ? vx_i : ball_i.vx;
+        ball_i.vy = contact ? vy_i : ball_i.vy;
+        ball_j.vx = contact ? vx_j : ball_j.vx;
+        ball_j.vy = contact ? vy_j : ball_j.vy;
+        ball_i.x = contact ? ball_i.x - correction_x : ball_i.x;
+        ball_i.y = contact ? ball_i.y - correction_y : ball_i.y;
+        ball_j.x = contact ? ball_j.x + correction_x : ball_j.x;
+        ball_j.y = contact ? ball_j.y + correction_y : ball_j.y;
+
+        settle_lanes(&ball_i, contact);
+        settle_lanes(&ball_j, contact);
+        store_ball(block, i, ball_i);
+        store_ball(block, j, ball_j);
+    }
+}
+
+static LANES_INLINE lane_int in_open(const BatchTable &table, const BallLanes &ball) {
+    return (ball.x > table.open_low.x) & (ball.x < table.open_high.x) &
+           (ball.y > table.open_low.y) & (ball.y < table.open_high.y);
+}
+
+// touches_segment() and reflect() for every cushion in line order
+static LANES_INLINE void cushion_lanes(const BatchTable &table, BatchBlock *block, lane_int running) {
+    const lane_float zero = splat(0.f), one = splat(1.f);
+
+    for(size_t k = 0; k < table.radius.size(); k++) {
+        BallLanes ball = load_ball(block, k);
+        lane_int awake = is_moving(ball.flags) & running & ~in_open(table, ball);
+        if(!any(awake)) continue;
+
+        float radius = table.radius[k];
+        // A unit of slack so the box never rejects a touch the exact test accepts
+        float margin = radius + 1.f;
+        bool reflected = false;
+        for(auto &cushion : table.cushions) {
+            lane_int near = awake &
+                            (ball.x >= cushion.low.x - margin) & (ball.x <= cushion.high.x + margin) &
+                            (ball.y >= cushion.low.y - margin) & (ball.y <= cushion.high.y + margin);
+            if(!any(near)) continue;
+
+            lane_float offset_x = ball.x - cushion.p1.x;
+            lane_float offset_y = ball.y - cushion.p1.y;
+            lane_float t = (offset_x*cushion.direction.x + offset_y*cushion.direction.y)*cushion.inverse_length_squared;
+            t = t < zero ? zero : t;
+            t = t > one ? one : t;
+            lane_float gap_x = offset_x - cushion.direction.x*t;
+            lane_float gap_y = offset_y - cushion.direction.y*t;
+            lane_int touch = near & (gap_x*gap_x + gap_y*gap_y <= radius*radius);
+            if(!any(touch)) continue;
+
+            lane_float along = ball.vx*cushion.normal.x + ball.vy*cushion.normal.y;
+            ball.vx = touch ? ball.vx - cushion.normal.x*(along*2.f) : ball.vx;
+            ball.vy = touch ? ball.vy - cushion.normal.y*(along*2.f) : ball.vy;
+            reflected = true;
+        }
+        if(reflected) store_ball(block, k, ball);
+    }
+}
+
+static LANES_INLINE void pocket_lanes(const BatchTable &table, BatchBlock *block, lane_int running) {
+    const lane_float zero = splat(0.f);
+    float reach_squared = table.pocket_radius*table.pocket_radius;
+
+    for(size_t k = 0; k < table.radius.size(); k++) {
+        BallLanes ball = load_ball(block, k);
+        lane_int left = is_moving(ball.flags) & running & ~in_open(table, ball);
+        if(!any(left)) continue;
+
+        lane_int pocket = load<lane_int>(&block->pocket[k*batch_lanes]);
+        bool sank = false;
+        for(size_t p = 0; p < table.pockets.size(); p++) {
+            lane_float gap_x = ball.x - table.pockets[p].x;
+            lane_float gap_y = ball.y - table.pockets[p].y;
+            lane_int sunk = left & (gap_x*gap_x + gap_y*gap_y <= reach_squared);
+            if(!any(sunk)) continue;
+
+            ball.x = sunk ? splat(table.pockets[p].x) : ball.x;
+            ball.y = sunk ? splat(table.pockets[p].y) : ball.y;
+            ball.vx = sunk ? zero : ball.vx;
+            ball.vy = sunk ? zero : ball.vy;
+            ball.flags = sunk ? pocketed_bit : ball.flags;
+            pocket = sunk ? (int32_t)p : pocket;
+            left &= ~sunk;
+            sank = true;
+        }
+        if(sank) {
+            store_ball(block, k, ball);
+            store(&block->pocket[k*batch_lanes], pocket);
+        }
+    }
+}
+
+static LANES_INLINE void tick_lanes(const BatchTable &table, BatchBlock *block, float dt, int max_ticks) {
+    lane_int running = load<lane_int>(block->running);
+    float sub_dt = dt / sub_updates;
+    for(int s = 0; s < sub_updates; s++) {
+        integrate_lanes(table, block, running, sub_dt);
+        collide_lanes(table, block, running);
+        cushion_lanes(table, block, running);
+        pocket_lanes(table, block, running);
+    }
+
+    // Stop the tables that came to rest or ran out of ticks
+    lane_int moving = lane_int{};
+    for(size_t k = 0; k < table.radius.size(); k++) {
+        moving |= load<lane_int>(&block->flags[k*batch_lanes]);
+    }
+    // running is -1 in the lanes still stepping
+    lane_int ticks = load<lane_int>(block->ticks) - running;
+    running &= ((moving & moving_bit) != 0) & (ticks < max_ticks);
+    store(block->ticks, ticks);
+    store(block->running, running);
+}
+
+static void tick_block_default(const BatchTable &table, BatchBlock *block, float dt, int max_ticks) {
+    tick_lanes(table, block, dt, max_ticks);
+}
+
+#ifdef TABLE_BATCH_X86
+
+__attribute__((target("avx2")))
+static void tick_block_avx2(const BatchTable &table, BatchBlock *block, float dt, int max_ticks) {
+    tick_lanes(table, block, dt, max_ticks);
+}
+
+static bool has_avx2() {
+    static const bool supported = __builtin_cpu_supports("avx2");
+    return supported;
+}
+
+#endif
+
+static void tick_block(const BatchTable &table, BatchBlock *block, float dt, int max_ticks) {
+#ifdef TABLE_BATCH_X86
+    if(has_avx2()) {
+        tick_block_avx2(table, block, dt, max_ticks);
+        return;
+    }
+#endif
+    tick_block_default(table, block, dt, max_ticks);
+}
+
+// Batch
+
+// Starts from the box around every cushion and cuts away each cushion and
+// pocket it still overlaps, from whichever side keeps the most area. Any
+// box works as long as nothing is left inside it, on a plain table this
+// one covers most of the cloth.
+static void find_open_box(BatchTable *table) {
+    if(table->cushions.empty()) {
+        table->open_low = table->open_high = {0.f, 0.f};
+        return;
+    }
+
+    float reach = 1.f;
+    for(float r : table->radius) {
+        reach = max(reach, r + 1.f);
+    }
+
+    vector<pair<Vector2<float>, Vector2<float>>> obstacles;
+    Vector2<float> low = table->cushions[0].low, high = table->cushions[0].high;
+    for(auto &cushion : table->cushions) {
+        obstacles.push_back({cushion.low - reach, cushion.high + reach});
+        low = {min(low.x, cushion.low.x), min(low.y, cushion.low.y)};
+        high = {max(high.x, cushion.high.x), max(high.y, cushion.high.y)};
+    }
+    for(auto &p : table->pockets) {
+        obstacles.push_back({p - (table->pocket_radius + 1.f), p + (table->pocket_radius + 1.f)});
+    }
+
+    for(auto &obstacle : obstacles) {
+        Vector2<float> o_low = obstacle.first, o_high = obstacle.second;
+        if(o_high.x <= low.x || o_low.x >= high.x || o_high.y <= low.y || o_low.y >= high.y) continue;
+
+        float width = high.x - low.x, height = high.y - low.y;
+        float keep[4] = {
+            (high.x - o_high.x)*height,
+            (o_low.x - low.x)*height,
+            (high.y - o_high.y)*width,
+            (o_low.y - low.y)*width
+        };
+        int side = max_element(keep, keep + 4) - keep;
+        if(side == 0) low.x = o_high.x;
+        else if(side == 1) high.x = o_low.x;
+        else if(side == 2) low.y = o_high.y;
+        else high.y = o_low.y;
+    }
+    table->open_low = low;
+    table->open_high = high;
+}
+
+TableBatch::TableBatch(const PhysicsWorld &world, size_t table_count, size_t threads) : pool(threads) {
+    const BallStore &balls = world.balls;
+    table.friction.assign(balls.friction.begin(), balls.friction.end());
+    table.radius.assign(balls.radius.begin(), balls.radius.end());
+    table.mass.assign(balls.mass.begin(), balls.mass.end());
+    for(auto &line : world.lines) {
+        BatchTable::Cushion cushion;
+        cushion.p1 = line.p1;
+        cushion.direction = line.p2 - line.p1;
+        cushion.normal = line.normal;
+        cushion.low = {min(line.p1.x, line.p2.x), min(line.p1.y, line.p2.y)};
+        cushion.high = {max(line.p1.x, line.p2.x), max(line.p1.y, line.p2.y)};
+        cushion.inverse_length_squared = 1.f/dot(cushion.direction, cushion.direction);
+        table.cushions.push_back(cushion);
+    }
+    table.pockets = world.pockets;
+    table.pocket_radius = world.pocket_radius;
+    find_open_box(&table);
+    for(uint32_t i = 0; i < balls.size(); i++) {
+        for(uint32_t j = 0; j < i; j++) {
+            table.pairs.push_back({i, j});
+        }
+    }
+
+    tables = table_count;
+    max_ticks = 120*60;
+    blocks.resize((table_count + batch_lanes - 1)/batch_lanes);
+    size_t slots = balls.size()*batch_lanes;
+    for(auto &block : blocks) {
+        block.x.assign(slots, 0.f);
+        block.y.assign(slots, 0.f);
+        block.vx.assign(slots, 0.f);
+        block.vy.assign(slots, 0.f);
+        block.flags.assign(slots, 0);
+        block.pocket.assign(slots, -1);
+        block.candidates.assign(table.pairs.size()*batch_lanes, 0);
+        block.awake.assign(balls.size(), 0);
+        fill(begin(block.running), end(block.running), 0);
+        fill(begin(block.ticks), end(block.ticks), 0);
+    }
+    for(size_t t = 0; t < table_count; t++) {
+        set_table(t, world);
+    }
+}
+
+void TableBatch::set_table(size_t t, const PhysicsWorld &world) {
+    BatchBlock &block = blocks[t/batch_lanes];
+    size_t l = t % batch_lanes;
+    const BallStore &balls = world.balls;
+
+    bool moving = false;
+    for(size_t k = 0; k < table.radius.size(); k++) {
+        size_t at = k*batch_lanes + l;
+        block.x[at] = balls.x[k];
+        block.y[at] = balls.y[k];
+        block.vx[at] = balls.vx[k];
+        block.vy[at] = balls.vy[k];
+        block.flags[at] = balls.flags[k];
+        block.pocket[at] = balls.pocket[k];
+        moving |= balls.is_moving(k);
+    }
+    block.running[l] = moving ? -1 : 0;
+    block.ticks[l] = 0;
+}
+
+void TableBatch::get_table(size_t t, PhysicsWorld *world) const {
+    const BatchBlock &block = blocks[t/batch_lanes];
+    size_t l = t % batch_lanes;
+    BallStore &balls = world->balls;
+
+    for(size_t k = 0; k < table.radius.size(); k++) {
+        size_t at = k*batch_lanes + l;
+        balls.x[k] = block.x[at];
+        balls.y[k] = block.y[at];
+        balls.vx[k] = block.vx[at];
+        balls.vy[k] = block.vy[at];
+        balls.flags[k] = block.flags[at];
+        balls.pocket[k] = block.pocket[at];
+    }
+}
+
+void TableBatch::shoot(size_t t, Vector2<float> cue_velocity) {
+    BatchBlock &block = blocks[t/batch_lanes];
+    size_t l = t % batch_lanes;
+    if(block.flags[l] & BALL_POCKETED) return;
+
+    block.vx[l] = cue_velocity.x;
+    block.vy[l] = cue_velocity.y;
+    block.flags[l] |= BALL_MOVING;
+    block.running[l] = -1;
+    block.ticks[l] = 0;
+}
+
+bool TableBatch::is_running(size_t t) const {
+    return blocks[t/batch_lanes].running[t % batch_lanes] != 0;
+}
+
+int TableBatch::ticks(size_t t) const {
+    return blocks[t/batch_lanes].ticks[t % batch_lanes];
+}
+
+size_t TableBatch::running() const {
+    size_t count = 0;
+    for(size_t t = 0; t < tables; t++) {
+        count += is_running(t);
+    }
+    return count;
+}
+
+static bool any_running(const BatchBlock &block) {
+    int32_t running = 0;
+    for(int32_t lane : block.running) {
+        running |= lane;
+    }
+    return running != 0;
+}
+
+// Blocks are dealt out round robin, several per thread, so a thread with
+// tables that stop early does not leave the others waiting on it
+void TableBatch::for_each_block(const function<void(BatchBlock *)> &work) {
+    size_t tasks = min(blocks.size(), pool.size()*4);
+    for(size_t task = 0; task < tasks; task++) {
+        pool.submit([this, &work, task, tasks] {
+            for(size_t b = task; b < blocks.size(); b += tasks) {
+                if(any_running(blocks[b])) work(&blocks[b]);
+            }
+        });
+    }
+    pool.wait_idle();
+}
+
+void TableBatch::update(float dt) {
+    for_each_block([this, dt](BatchBlock *block) {
+        tick_block(table, block, dt, max_ticks);
+    });
+}
+
+void TableBatch::run_to_rest(float dt) {
+    for_each_block([this, dt](BatchBlock *block) {
+        while(any_running(*block)) {
+            tick_block(table, block, dt, max_ticks);
+        }
+    });
+}
@@ -0,0 +1,98 @@
+#include <vector>
+#include <cstdint>
+#include <functional>
+#include "physics.hpp"
+#include "thread_pool.hpp"
+
+#pragma once
+
+using namespace std;
+
+// Tables per block, one per SIMD lane. Eight floats fill an AVX2
+// register, without AVX2 the compiler splits each operation in halves.
+const size_t batch_lanes = 8;
+
+// What every table in a batch shares: the table it was made from
+struct BatchTable {
+    struct Cushion {
+        Vector2<float> p1, direction, normal;
+        // Bounding box of the segment, to skip balls nowhere near it
+        Vector2<float> low, high;
+        float          inverse_length_squared;
+    };
+
+    vector<float>          friction, radius, mass;
+    vector<Cushion>        cushions;
+    vector<Vector2<float>> pockets;
+    float                  pocket_radius;
+    // Box no ball centre inside can touch a cushion or reach a pocket from
+    Vector2<float>         open_low, open_high;
+    // Every pair i > j, in the order PhysicsWorld resolves them
+    vector<BallPair>       pairs;
+};
+
+// batch_lanes tables. Arrays hold batch_lanes values per ball, ball k of
+// table block*batch_lanes + l is at [k*batch_lanes + l], so one load
+// brings in that ball for every table of the block.
+struct BatchBlock {
+    vector<float>    x, y, vx, vy;
+    vector<int32_t>  flags, pocket;
+    // -1 while the table steps, 0 once it stopped
+    int32_t          running[batch_lanes];
+    int32_t          ticks[batch_lanes];
+    // Balls awake in any lane, lanes where each pair was found this
+    // sub-step, and the pairs found at all
+    vector<uint8_t>  awake;
+    vector<int32_t>  candidates;
+    vector<uint32_t> found;
+};
+
+// Many copies of one table stepped in lockstep, for training runs that
+// care about table-steps per second rather than one table's latency.
+// Tables share cushions, pockets and ball sizes and differ only in ball
+// state. Each lane does the same float operations in the same order as
+// PhysicsWorld::update, so a table ends on the same bits either way.
+//
+// A table stops when all its balls rest or it reaches max_ticks, its lane
+// is masked off from then on and a block with no lane left is skipped.
+// Blocks are independent, so they are spread over a thread pool.
+
+class TableBatch {
+    private:
+    BatchTable         table;
+    vector<BatchBlock> blocks;
+    size_t             tables;
+    ThreadPool         pool;
+
+    void for_each_block(const function<void(BatchBlock *)> &work);
+
+    public:
+    int max_ticks;
+
+    // Every table starts as a copy of table. 0 threads means one per core
+    TableBatch(const PhysicsWorld &table, size_t table_count, size_t threads = 0);
+
+    size_t size() const {
+        return tables;
+    }
+
+    size_t threads() const {
+        return pool.size();
+    }
+
+    // Ball state in and out of table t, world must have the same balls
+    void set_table(size_t t, const PhysicsWorld &world);
+    void get_table(size_t t, PhysicsWorld *world) const;
+
+    // Hits the cue ball of table t and lets it step again
+    void shoot(size_t t, Vector2<float> cue_velocity);
+
+    bool is_running(size_t t) const;
+    int ticks(size_t t) const;
+    size_t running() const;
+
+    // One tick of every running table
+    void update(float dt);
+    // Ticks until every table has stopped, each block without waiting on the others
+    void run_to_rest(float dt);
+};
@@ -0,0 +1,97 @@
+#include "thread_pool.hpp"
+
+using namespace std;
+
+ThreadPool::ThreadPool(size_t thread_count) {
+    if(thread_count == 0) thread_count = max(1u, thread::hardware_concurrency());
+
+    next_worker = 0;
+    queued = 0;
+    pending = 0;
+    stopping = false;
+
+    for(size_t i = 0; i < thread_count; i++) {
+        workers.push_back(make_unique<Worker>());
+    }
+    for(size_t i = 0; i < thread_count; i++) {
+        threads.emplace_back(&ThreadPool::run, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        lock_guard<mutex> guard(sleep_lock);
+        stopping = true;
+    }
+    wake.notify_all();
+    for(auto &t : threads) {
+        t.join();
+    }
+}
+
+void ThreadPool::submit(function<void()> task) {
+    size_t target = next_worker++ % workers.size();
+    pending++;
+    {
+        lock_guard<mutex> guard(workers[target]->lock);
+        workers[target]->tasks.push_back(move(task));
+        queued++;
+    }
+    {
+        // Taking the lock orders this with a worker about to sleep
+        lock_guard<mutex> guard(sleep_lock);
+    }
+    wake.notify_one();
+}
+
+bool ThreadPool::pop_or_steal(size_t self, function<void()> *task) {
+    {
+        Worker &own = *workers[self];
+        lock_guard<mutex> guard(own.lock);
+        if(!own.tasks.empty()) {
+            *task = move(own.tasks.back());
+            own.tasks.pop_back();
+            queued--;
+            return true;
+        }
+    }
+    for(size_t k = 1; k < workers.size(); k++) {
+        Worker &victim = *workers[(self + k) % workers.size()];
+        lock_guard<mutex> guard(victim.lock);
+        if(!victim.tasks.empty()) {
+            *task = move(victim.tasks.front());
+            victim.tasks.pop_front();
+            queued--;
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPool::finish() {
+    if(--pending == 0) {
+        lock_guard<mutex> guard(sleep_lock);
+        idle.notify_all();
+    }
+}
+
+void ThreadPool::run(size_t self) {
+    function<void()> task;
+    while(true) {
+        if(pop_or_steal(self, &task)) {
+            task();
+            task = nullptr;
+            finish();
+            continue;
+        }
+
+        unique_lock<mutex> guard(sleep_lock);
+        wake.wait(guard, [this] { return stopping || queued > 0; });
+        if(stopping && queued == 0) return;
+    }
+}
+
+void ThreadPool::wait_idle() {
+    unique_lock<mutex> guard(sleep_lock);
+    idle.wait(guard, [this] { return pending == 0; });
+}
@@ -0,0 +1,56 @@
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+
+#pragma once
+
+using namespace std;
+
+// Fixed set of workers, each with its own task deque. A worker takes
+// from the back of its own deque and, once that is empty, steals from
+// the front of the others, so uneven tasks (a shot that runs for ten
+// seconds next to one that stops at once) still keep every core busy.
+
+class ThreadPool {
+    private:
+    struct Worker {
+        deque<function<void()>> tasks;
+        mutex                   lock;
+    };
+
+    vector<unique_ptr<Worker>> workers;
+    vector<thread>             threads;
+    atomic<size_t>             next_worker;
+    // Tasks sitting in a deque, and tasks not yet finished
+    atomic<long>               queued;
+    atomic<long>               pending;
+    atomic<bool>               stopping;
+    mutex                      sleep_lock;
+    condition_variable         wake;
+    condition_variable         idle;
+
+    bool pop_or_steal(size_t self, function<void()> *task);
+    void finish();
+    void run(size_t self);
+
+    public:
+    // 0 threads means one per hardware thread
+    ThreadPool(size_t thread_count = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    size_t size() const {
+        return threads.size();
+    }
+
+    void submit(function<void()> task);
+    // Blocks until every submitted task has finished
+    void wait_idle();
+};
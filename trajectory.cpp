@@ -0,0 +1,269 @@
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include "trajectory.hpp"
+
+using namespace std;
+
+// Files are written in host byte order, which is little-endian everywhere
+// this game builds
+
+template<class T>
+static void append(vector<uint8_t> *bytes, const T &value) {
+    const uint8_t *raw = (const uint8_t *)&value;
+    bytes->insert(bytes->end(), raw, raw + sizeof(T));
+}
+
+template<class T>
+static T load(const uint8_t *at) {
+    T value;
+    memcpy(&value, at, sizeof(T));
+    return value;
+}
+
+// Writer
+
+TrajectoryWriter::TrajectoryWriter() {
+    file = nullptr;
+    memset(&header, 0, sizeof(header));
+}
+
+TrajectoryWriter::~TrajectoryWriter() {
+    close();
+}
+
+bool TrajectoryWriter::open(const string &path, size_t ball_count, float tick_dt, uint32_t keyframe_interval) {
+    close();
+    if(ball_count > UINT16_MAX) return false;
+    file = fopen(path.c_str(), "wb");
+    if(!file) return false;
+
+    header.magic = trajectory_magic;
+    header.version = trajectory_version;
+    header.ball_count = ball_count;
+    header.tick_dt = tick_dt;
+    header.keyframe_interval = max(1u, keyframe_interval);
+    header.tick_count = 0;
+    header.keyframe_count = 0;
+    header.index_offset = 0;
+    keyframes.clear();
+
+    // Rewritten with the final counts by close()
+    fwrite(&header, sizeof(header), 1, file);
+    return true;
+}
+
+void TrajectoryWriter::write_keyframe(const BallStore &balls) {
+    keyframes.push_back({header.tick_count, (uint64_t)ftell(file)});
+
+    record.clear();
+    append(&record, (uint8_t)RECORD_KEYFRAME);
+    append(&record, header.tick_count);
+    for(size_t i = 0; i < balls.size(); i++) {
+        append(&record, balls.x[i]);
+        append(&record, balls.y[i]);
+        append(&record, (uint8_t)balls.flags[i]);
+    }
+    decoded_x.assign(balls.x.begin(), balls.x.end());
+    decoded_y.assign(balls.y.begin(), balls.y.end());
+    decoded_flags.assign(balls.flags.begin(), balls.flags.end());
+}
+
+void TrajectoryWriter::write_delta(const BallStore &balls) {
+    size_t n = balls.size();
+    size_t mask_bytes = (n + 7)/8;
+
+    record.clear();
+    append(&record, (uint8_t)RECORD_DELTA);
+    record.resize(1 + mask_bytes, 0);
+
+    for(size_t i = 0; i < n; i++) {
+        uint8_t flags = balls.flags[i];
+        if(balls.x[i] == decoded_x[i] && balls.y[i] == decoded_y[i] && flags == decoded_flags[i]) continue;
+
+        float dx = roundf((balls.x[i] - decoded_x[i])*delta_units);
+        float dy = roundf((balls.y[i] - decoded_y[i])*delta_units);
+        bool fits = fabsf(dx) <= INT16_MAX && fabsf(dy) <= INT16_MAX;
+        // Moves too small to encode are left for a later tick to pick up
+        if(fits && dx == 0 && dy == 0 && flags == decoded_flags[i]) continue;
+
+        record[1 + i/8] |= 1 << (i % 8);
+        if(fits && flags == decoded_flags[i]) {
+            append(&record, (int16_t)dx);
+            append(&record, (int16_t)dy);
+            decoded_x[i] += dx/delta_units;
+            decoded_y[i] += dy/delta_units;
+        }
+        else {
+            append(&record, delta_escape);
+            append(&record, balls.x[i]);
+            append(&record, balls.y[i]);
+            append(&record, flags);
+            decoded_x[i] = balls.x[i];
+            decoded_y[i] = balls.y[i];
+            decoded_flags[i] = flags;
+        }
+    }
+}
+
+void TrajectoryWriter::record_tick(const BallStore &balls) {
+    if(!file || balls.size() != header.ball_count) return;
+
+    if(header.tick_count % header.keyframe_interval == 0) {
+        write_keyframe(balls);
+    }
+    else {
+        write_delta(balls);
+    }
+    fwrite(record.data(), 1, record.size(), file);
+    header.tick_count++;
+}
+
+bool TrajectoryWriter::close() {
+    if(!file) return false;
+
+    header.index_offset = ftell(file);
+    header.keyframe_count = keyframes.size();
+    fwrite(keyframes.data(), sizeof(TrajectoryKeyframe), keyframes.size(), file);
+    fseek(file, 0, SEEK_SET);
+    fwrite(&header, sizeof(header), 1, file);
+
+    bool ok = !ferror(file);
+    fclose(file);
+    file = nullptr;
+    return ok;
+}
+
+long TrajectoryWriter::bytes_written() const {
+    return file ? ftell(file) : 0;
+}
+
+// Reader
+
+TrajectoryReader::TrajectoryReader() {
+    header = nullptr;
+    keyframes = nullptr;
+    cursor = 0;
+    tick = -1;
+}
+
+TrajectoryReader::~TrajectoryReader() {
+    close();
+}
+
+bool TrajectoryReader::open(const string &path) {
+    close();
+    if(!file.open(path)) return false;
+
+    // Reject anything truncated or from another version before trusting offsets
+    const uint8_t *data = file.bytes();
+    size_t length = file.size();
+    header = (const TrajectoryHeader *)data;
+    bool valid = length >= sizeof(TrajectoryHeader) && header->magic == trajectory_magic &&
+                 header->version == trajectory_version && header->keyframe_count > 0 &&
+                 header->tick_dt > 0 && isfinite(header->tick_dt) &&
+                 header->index_offset <= length &&
+                 (length - header->index_offset)/sizeof(TrajectoryKeyframe) >= header->keyframe_count;
+    if(!valid) {
+        close();
+        return false;
+    }
+    keyframes = (const TrajectoryKeyframe *)(data + header->index_offset);
+
+    // seek() looks keyframes up by tick, so the first has to be tick 0 and
+    // every one has to point at a record inside the file
+    valid = header->tick_count > 0 && keyframes[0].tick == 0;
+    for(uint32_t k = 0; valid && k < header->keyframe_count; k++) {
+        valid = keyframes[k].offset >= sizeof(TrajectoryHeader) && keyframes[k].offset < header->index_offset &&
+                keyframes[k].tick < header->tick_count && (k == 0 || keyframes[k].tick > keyframes[k - 1].tick);
+    }
+    if(!valid) {
+        close();
+        return false;
+    }
+
+    x.assign(header->ball_count, 0.f);
+    y.assign(header->ball_count, 0.f);
+    flags.assign(header->ball_count, 0);
+    tick = -1;
+    return seek(0);
+}
+
+void TrajectoryReader::close() {
+    file.close();
+    header = nullptr;
+    keyframes = nullptr;
+    tick = -1;
+}
+
+bool TrajectoryReader::decode_record() {
+    size_t n = header->ball_count;
+    size_t end = header->index_offset;
+    if(cursor >= end) return false;
+
+    const uint8_t *data = file.bytes();
+    const uint8_t *at = data + cursor;
+    uint8_t type = at[0];
+    at++;
+
+    if(type == RECORD_KEYFRAME) {
+        if(cursor + 1 + 4 + n*9 > end) return false;
+        at += 4;
+        for(size_t i = 0; i < n; i++) {
+            x[i] = load<float>(at);
+            y[i] = load<float>(at + 4);
+            flags[i] = at[8];
+            at += 9;
+        }
+    }
+    else if(type == RECORD_DELTA) {
+        size_t mask_bytes = (n + 7)/8;
+        if(cursor + 1 + mask_bytes > end) return false;
+        const uint8_t *mask = at;
+        at += mask_bytes;
+        for(size_t i = 0; i < n; i++) {
+            if(!(mask[i/8] & (1 << (i % 8)))) continue;
+            if(at + 4 > data + end) return false;
+            int16_t dx = load<int16_t>(at);
+            if(dx == delta_escape) {
+                if(at + 11 > data + end) return false;
+                x[i] = load<float>(at + 2);
+                y[i] = load<float>(at + 6);
+                flags[i] = at[10];
+                at += 11;
+            }
+            else {
+                x[i] += dx/delta_units;
+                y[i] += load<int16_t>(at + 2)/delta_units;
+                at += 4;
+            }
+        }
+    }
+    else {
+        return false;
+    }
+
+    cursor = at - data;
+    tick++;
+    return true;
+}
+
+bool TrajectoryReader::seek(long target_tick) {
+    if(!header) return false;
+    target_tick = clamp(target_tick, 0L, (long)header->tick_count - 1);
+
+    // Keep decoding forward when the target is ahead in the same keyframe
+    // span, otherwise restart at the closest keyframe before it
+    const TrajectoryKeyframe *end = keyframes + header->keyframe_count;
+    const TrajectoryKeyframe *key = upper_bound(keyframes, end, (uint32_t)target_tick,
+        [](uint32_t t, const TrajectoryKeyframe &k) { return t < k.tick; }) - 1;
+    if(tick < 0 || target_tick < tick || (long)key->tick > tick) {
+        cursor = key->offset;
+        tick = (long)key->tick - 1;
+    }
+
+    while(tick < target_tick) {
+        if(!decode_record()) return false;
+    }
+    return true;
+}
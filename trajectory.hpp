@@ -0,0 +1,141 @@
+#include <vector>
+#include <string>
+#include <cstdio>
+#include <cstdint>
+#include "physics.hpp"
+#include "mapped_file.hpp"
+
+#pragma once
+
+using namespace std;
+
+// Binary recording of a shot, one record per physics tick.
+//
+//   header      TrajectoryHeader
+//   records     keyframe every keyframe_interval ticks, deltas between
+//   index       keyframe_count x TrajectoryKeyframe, at index_offset
+//
+// A keyframe holds every ball's exact position and flags. A delta holds
+// a bitmask of the balls that changed, then for each of them the move
+// in 1/64 world units as two int16s. A ball whose move does not fit, or
+// whose flags changed, writes delta_escape followed by its exact
+// position and flags. The writer encodes against what a reader will
+// decode, so rounding never accumulates between keyframes.
+
+const uint32_t trajectory_magic = 0x4a525442; // "BTRJ"
+const uint16_t trajectory_version = 1;
+const uint32_t default_keyframe_interval = 60;
+const float    delta_units = 64.f;
+const int16_t  delta_escape = INT16_MIN;
+
+enum trajectory_record : uint8_t {
+    RECORD_KEYFRAME = 1,
+    RECORD_DELTA    = 2
+};
+
+#pragma pack(push, 1)
+struct TrajectoryHeader {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t ball_count;
+    float    tick_dt;
+    uint32_t keyframe_interval;
+    uint32_t tick_count;
+    uint32_t keyframe_count;
+    uint64_t index_offset;
+};
+
+struct TrajectoryKeyframe {
+    uint32_t tick;
+    uint64_t offset;
+};
+#pragma pack(pop)
+
+class TrajectoryWriter {
+    private:
+    FILE            *file;
+    TrajectoryHeader header;
+    vector<TrajectoryKeyframe> keyframes;
+    // Positions as the reader will have decoded them
+    vector<float>   decoded_x, decoded_y;
+    vector<uint8_t> decoded_flags;
+    vector<uint8_t> record;
+
+    void write_keyframe(const BallStore &balls);
+    void write_delta(const BallStore &balls);
+
+    public:
+    TrajectoryWriter();
+    ~TrajectoryWriter();
+
+    TrajectoryWriter(const TrajectoryWriter &) = delete;
+    TrajectoryWriter &operator=(const TrajectoryWriter &) = delete;
+
+    bool open(const string &path, size_t ball_count, float tick_dt, uint32_t keyframe_interval = default_keyframe_interval);
+    bool is_open() const {
+        return file != nullptr;
+    }
+    // Appends the state after one tick, the first call is tick 0
+    void record_tick(const BallStore &balls);
+    // Writes the keyframe index and the final header
+    bool close();
+
+    long bytes_written() const;
+};
+
+// Plays a recording back from a memory-mapped file. seek() decodes from
+// the nearest keyframe at or before the wanted tick, and stepping one
+// tick forward from the current position only decodes that one record.
+
+class TrajectoryReader {
+    private:
+    MappedFile     file;
+    const TrajectoryHeader   *header;
+    const TrajectoryKeyframe *keyframes;
+    // Offset of the record for tick + 1
+    size_t         cursor;
+
+    bool decode_record();
+
+    public:
+    long             tick;
+    vector<float>    x, y;
+    vector<uint8_t>  flags;
+
+    TrajectoryReader();
+    ~TrajectoryReader();
+
+    TrajectoryReader(const TrajectoryReader &) = delete;
+    TrajectoryReader &operator=(const TrajectoryReader &) = delete;
+
+    bool open(const string &path);
+    void close();
+    bool is_open() const {
+        return header != nullptr;
+    }
+
+    size_t ball_count() const {
+        return header ? header->ball_count : 0;
+    }
+    long tick_count() const {
+        return header ? header->tick_count : 0;
+    }
+    float tick_dt() const {
+        return header ? header->tick_dt : 0.f;
+    }
+
+    bool seek(long target_tick);
+    // Times past the end or not a number clamp like seek(), before the
+    // cast to long could overflow
+    bool seek_time(float seconds) {
+        float ticks = seconds/tick_dt();
+        return seek(ticks >= tick_count() ? tick_count() : ticks > 0 ? (long)(ticks + .5f) : 0);
+    }
+
+    Vector2<float> position(size_t i) const {
+        return {x[i], y[i]};
+    }
+    bool is_pocketed(size_t i) const {
+        return flags[i] & BALL_POCKETED;
+    }
+};
@@ -0,0 +1,52 @@
+#include <atomic>
+#include <cstdint>
+
+#pragma once
+
+using namespace std;
+
+// Lock-free triple buffer for one writer and one reader. The writer fills
+// its back slot and publishes it by swapping it with the shared middle
+// slot; the reader swaps its front slot with the middle one whenever a
+// newer value is waiting. Neither side ever waits for the other, and a
+// slot is never touched by both at once.
+
+template<class T>
+class TripleBuffer {
+    private:
+    T slots[3];
+    // Middle slot index, with `fresh` set until the reader has taken it
+    atomic<uint8_t> middle;
+    uint8_t         back;
+    uint8_t         front;
+
+    static const uint8_t index_mask = 3;
+    static const uint8_t fresh = 4;
+
+    public:
+    TripleBuffer() : middle(1) {
+        back = 0;
+        front = 2;
+    }
+
+    TripleBuffer(const TripleBuffer &) = delete;
+    TripleBuffer &operator=(const TripleBuffer &) = delete;
+
+    // Writer side. The slot holds whatever was published two swaps ago,
+    // so every field has to be written before publish()
+    T &write_slot() {
+        return slots[back];
+    }
+
+    void publish() {
+        back = middle.exchange(back | fresh, memory_order_acq_rel) & index_mask;
+    }
+
+    // Reader side. The reference stays valid until the next read()
+    const T &read() {
+        if(middle.load(memory_order_acquire) & fresh) {
+            front = middle.exchange(front, memory_order_acq_rel) & index_mask;
+        }
+        return slots[front];
+    }
+};
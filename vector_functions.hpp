@@ -1,31 +1,109 @@
 #include <cmath>
-#include "classes.hpp"
 
 #pragma once
 
-float distance(Vector2<float> a, Vector2<float> b) {
-    return sqrt(pow((b.x - a.x), 2) + pow((b.y - a.y), 2));
+#define PI 3.14159265359
+
+using namespace std;
+
+// Vector and functions
+
+template<class T>
+struct Vector2 {
+    T x, y;
+
+    // Vector-Scalar
+    inline Vector2 operator+(T val) const {
+        return {x + val, y + val};
+    }
+
+    inline Vector2 operator-(T val) const {
+        return {x - val, y - val};
+    }
+
+    inline Vector2 operator*(T val) const {
+        return {x*val, y*val};
+    }
+
+    inline Vector2 operator/(T val) const {
+        return {x/val, y/val};
+    }
+
+    // Vector-Vector
+    inline Vector2 operator+(Vector2 other) const {
+        return {x + other.x, y + other.y};
+    }
+
+    inline Vector2 operator-(Vector2 other) const {
+        return {x - other.x, y - other.y};
+    }
+
+    inline Vector2 operator*(Vector2 other) const {
+        return {x*other.x, y*other.y};
+    }
+
+    inline Vector2 operator/(Vector2 other) const {
+        return {x/other.x, y/other.y};
+    }
+
+    // Equals
+
+    inline bool operator==(Vector2 other) const {
+        return x == other.x && y == other.y;
+    }
+};
+
+// Helpers work for any scalar with arithmetic operators and an
+// overload of scalar_sqrt(), see precision.hpp for the fixed-point one
+
+inline float scalar_sqrt(float value) {
+    return sqrtf(value);
+}
+
+inline double scalar_sqrt(double value) {
+    return sqrt(value);
+}
+
+template<class T>
+inline T dot(Vector2<T> a, Vector2<T> b) {
+    return a.x*b.x + a.y*b.y;
 }
 
-float magnitude(Vector2<float> vect) {
-    return sqrt(pow(vect.x, 2) + pow(vect.y, 2));
+// Prefer the squared forms for comparisons, they need no square root
+template<class T>
+inline T magnitude_squared(Vector2<T> vect) {
+    return dot(vect, vect);
 }
 
-Vector2<float> unit(Vector2<float> vect){
-    if(vect.x == 0 && vect.y == 0) {
-        return {0, 0};
+template<class T>
+inline T distance_squared(Vector2<T> a, Vector2<T> b) {
+    return magnitude_squared(b - a);
+}
+
+template<class T>
+inline T magnitude(Vector2<T> vect) {
+    return scalar_sqrt(magnitude_squared(vect));
+}
+
+template<class T>
+inline T distance(Vector2<T> a, Vector2<T> b) {
+    return magnitude(b - a);
+}
+
+template<class T>
+inline Vector2<T> unit(Vector2<T> vect){
+    if(vect.x == T(0) && vect.y == T(0)) {
+        return {T(0), T(0)};
     }
     return vect/magnitude(vect);
 }
 
-float angle(Vector2<float> a, Vector2<float> b) {
+template<class T>
+inline T angle(Vector2<T> a, Vector2<T> b) {
     return atan2(a.y - b.y, a.x - b.x);
 }
 
-float dot(Vector2<float> a, Vector2<float> b) {
-    return a.x*b.x + a.y*b.y;
-}
-
-Vector2<float> reflect(Vector2<float> vect, Vector2<float> norm) {
-    return (vect - norm*2*dot(norm, vect));
+template<class T>
+inline Vector2<T> reflect(Vector2<T> vect, Vector2<T> norm) {
+    return (vect - norm*(dot(norm, vect)*T(2)));
 }